@@ -29,7 +29,7 @@ class SampleNavigator final : public CustomComponent, public ValueListener<int>,
     using Drag = NavigatorParts;
 
 public:
-    SampleNavigator(APVTS& apvts, PluginParameters::State& pluginState, const juce::OwnedArray<CustomSamplerVoice>& synthVoices);
+    SampleNavigator(APVTS& apvts, PluginParameters::State& pluginState, const juce::Array<CustomSamplerVoice*>& synthVoices);
     ~SampleNavigator() override;
 
     //==============================================================================
@@ -97,7 +97,7 @@ private:
 
     const juce::AudioBuffer<float>* sample{ nullptr };
     float sampleRate;
-    const juce::OwnedArray<CustomSamplerVoice>& synthVoices;
+    const juce::Array<CustomSamplerVoice*>& synthVoices;
 
     juce::AudioParameterBool* isWavetableModeDisabled, * isLooping, * loopHasStart, * loopHasEnd;
     juce::ParameterAttachment isWavetableModeDisabledAttachment, loopAttachment, loopStartAttachment, loopEndAttachment;
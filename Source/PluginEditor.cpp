@@ -84,6 +84,8 @@ JustaSampleAudioProcessorEditor::JustaSampleAudioProcessorEditor(JustaSampleAudi
     darkModeButton(true, true, this),
     helpText("", defaultMessage),
     preFXAttachment(p.APVTS(), PluginParameters::PRE_FX, preFXButton),
+    sharedFXAttachment(p.APVTS(), PluginParameters::SHARED_FX, sharedFXButton),
+    freezeBungeeAttachment(p.APVTS(), PluginParameters::FREEZE_BUNGEE, freezeBungeeButton),
     showFXButton(true, true, this),
     showFXAttachment(showFXButton, pluginState.showFX, &dummyParam),
     darkModeAttachment(darkModeButton, pluginState.darkMode, &dummyParam),
@@ -91,6 +93,7 @@ JustaSampleAudioProcessorEditor::JustaSampleAudioProcessorEditor(JustaSampleAudi
     reverbEnablementAttachment(*p.APVTS().getParameter(PluginParameters::REVERB_ENABLED), [this](float newValue) { reverbEnabled = bool(newValue); fxEnablementChanged(); }, & p.getUndoManager()),
     distortionEnablementAttachment(*p.APVTS().getParameter(PluginParameters::DISTORTION_ENABLED), [this](float newValue) { distortionEnabled = bool(newValue); fxEnablementChanged(); }, &p.getUndoManager()),
     chorusEnablementAttachment(*p.APVTS().getParameter(PluginParameters::CHORUS_ENABLED), [this](float newValue) { chorusEnabled = bool(newValue); fxEnablementChanged(); }, &p.getUndoManager()),
+    sharedFXEnablementAttachment(*p.APVTS().getParameter(PluginParameters::SHARED_FX), [this](float newValue) { sharedFXEnabled = newValue >= 0.5f; fxEnablementChanged(); }, &p.getUndoManager()),
 
     lnf(dynamic_cast<CustomLookAndFeel&>(getLookAndFeel()))
 {
@@ -299,6 +302,14 @@ JustaSampleAudioProcessorEditor::JustaSampleAudioProcessorEditor(JustaSampleAudi
     preFXButton.setHelpText("Apply FX before Attack/Release");
     addAndMakeVisible(&preFXButton);
 
+    sharedFXButton.setButtonText("SHARED");
+    sharedFXButton.setHelpText("Apply FX once to the mix of all voices, which saves CPU with many voices");
+    addAndMakeVisible(&sharedFXButton);
+
+    freezeBungeeButton.setButtonText("FREEZE");
+    freezeBungeeButton.setHelpText("Render each key ahead of time in Bungee mode, which saves CPU while the pitch wheel and speed stay put");
+    addAndMakeVisible(&freezeBungeeButton);
+
     showFXButton.onStateChange = [this, minHeight, maxHeight]
     {
         auto constrainedBounds = getConstrainedBounds();
@@ -347,7 +358,7 @@ JustaSampleAudioProcessorEditor::~JustaSampleAudioProcessorEditor()
 void JustaSampleAudioProcessorEditor::timerCallback()
 {
     // If the processor has a new sample loaded, update the editor
-    if (pluginState.sampleHash != expectedHash && p.getSampleBuffer().getNumSamples())
+    if (p.getSampleVersion() != expectedSampleVersion && p.getSampleBuffer().getNumSamples())
     {
         loadSample();
 
@@ -361,6 +372,18 @@ void JustaSampleAudioProcessorEditor::timerCallback()
         resized();
     }
 
+    // While the rest of a large sample loads, the waveform fills in
+    const int loadedLength = p.getLoadedLength();
+    if (loadedLength != displayedLength && p.getSampleVersion() == expectedSampleVersion && !sampleEditor.isRecordingMode())
+    {
+        if (loadedLength > displayedLength)
+        {
+            sampleEditor.sampleUpdated(displayedLength, loadedLength);
+            sampleNavigator.sampleUpdated(displayedLength, loadedLength);
+        }
+        displayedLength = loadedLength;
+    }
+
     // If playback state has changed, update the sampleEditor and sampleNavigator
     bool wasPlaying = currentlyPlaying;
     currentlyPlaying = std::ranges::any_of(synthVoices, [](auto* voice) -> bool{ return bool(voice->getCurrentlyPlayingSound()); });
@@ -750,6 +773,16 @@ void JustaSampleAudioProcessorEditor::resized()
     preFXButton.setBorder(scalef(2.5f), scalef(6.f));
     preFXButton.setPadding(scalef(11.f));
 
+    footer.removeFromRight(scalei(15.f));
+    auto sharedFXButtonBounds = footer.removeFromRight(scalei(100.f)).reduced(0.f, scalei(11.f));
+    sharedFXButton.setBounds(sharedFXButtonBounds.toNearestInt());
+    sharedFXButton.setBorder(scalef(2.5f), scalef(6.f));
+
+    footer.removeFromRight(scalei(15.f));
+    auto freezeBungeeButtonBounds = footer.removeFromRight(scalei(100.f)).reduced(0.f, scalei(11.f));
+    freezeBungeeButton.setBounds(freezeBungeeButtonBounds.toNearestInt());
+    freezeBungeeButton.setBorder(scalef(2.5f), scalef(6.f));
+
     // FX
     if (pluginState.showFX)
     {
@@ -843,6 +876,8 @@ void JustaSampleAudioProcessorEditor::lookAndFeelChanged()
     pinButton.setColors(theme.dark, theme.slate.withAlpha(0.5f), shadow);
     darkModeButton.setColors(theme.dark, theme.slate.withAlpha(0.f), shadow);
     preFXButton.setColors(theme.darkerSlate, theme.light, shadow);
+    sharedFXButton.setColors(theme.darkerSlate, theme.light, shadow);
+    freezeBungeeButton.setColors(theme.darkerSlate, theme.light, shadow);
     showFXButton.setColors(theme.dark, theme.slate.withAlpha(0.f), shadow);
 
     tuningDetectButton.setColor(theme.dark);
@@ -862,7 +897,7 @@ void JustaSampleAudioProcessorEditor::lookAndFeelChanged()
     juce::Array<Component*> foregroundComponents = {
         &tuningLabel, &attackLabel, &releaseLabel, &playbackLabel, &loopingLabel, &masterLabel, &semitoneRotary, &waveformSemitoneRotary, &centRotary, &waveformCentRotary, &tuningDetectLabel, &tuningDetectButton,
         &attackTimeRotary, &attackCurve, &releaseTimeRotary, &releaseCurve, &lofiModeButton, &playbackModeButton, &playbackSpeedRotary, &loopStartButton, &loopButton, &loopEndButton,
-        &monoOutputButton, &gainSlider, &filenameComponent, &linkSampleToggle, &playStopButton, &recordButton, &deviceSettingsButton, &fitButton, &pinButton, &sampleNavigator, &preFXButton, &showFXButton
+        &monoOutputButton, &gainSlider, &filenameComponent, &linkSampleToggle, &playStopButton, &recordButton, &deviceSettingsButton, &fitButton, &pinButton, &sampleNavigator, &preFXButton, &sharedFXButton, &freezeBungeeButton, &showFXButton
     };
 
     for (Component* component : foregroundComponents)
@@ -974,7 +1009,8 @@ void JustaSampleAudioProcessorEditor::loadSample()
     bool sampleLoaded = p.getSampleBuffer().getNumSamples();
     if (sampleLoaded)
     {
-        expectedHash = pluginState.sampleHash;
+        expectedSampleVersion = p.getSampleVersion();
+        displayedLength = p.getLoadedLength();
         linkSampleToggle.setToggleState(pluginState.usingFileReference, juce::dontSendNotification);
 
         bool userLoad = userDraggedSample || p.hasLoadedFromReaper();
@@ -1165,6 +1201,7 @@ void JustaSampleAudioProcessorEditor::enablementChanged()
     lofiModeButton.setEnabled(isSampleLoaded && (!playbackModeButton.getChoice() || isWaveformMode));
 
     playbackSpeedRotary.setEnabled(isSampleLoaded && playbackModeButton.getChoice() && !isWaveformMode);
+    freezeBungeeButton.setEnabled(isSampleLoaded && playbackModeButton.getChoice() && !isWaveformMode);
     monoOutputButton.setEnabled(isSampleLoaded && p.getSampleBuffer().getNumChannels() > 1);
 
     linkSampleToggle.setEnabled(isSampleLoaded && !isRecording && !p.sampleBufferNeedsReference());
@@ -1177,7 +1214,9 @@ void JustaSampleAudioProcessorEditor::enablementChanged()
     if (navigatorWasVisible != sampleNavigator.isVisible())
         resized();
 
-    preFXButton.setEnabled(isSampleLoaded && (reverbEnabled || distortionEnabled || chorusEnabled || eqEnabled)),
+    const bool someFXEnabled = reverbEnabled || distortionEnabled || chorusEnabled || eqEnabled;
+    preFXButton.setEnabled(isSampleLoaded && someFXEnabled && !sharedFXEnabled);  // Shared FX always come after the envelope
+    sharedFXButton.setEnabled(isSampleLoaded && someFXEnabled);
 
     // Handle status label
     statusLabel.setVisible(!p.getSampleBuffer().getNumSamples() || p.getSampleLoader().isLoading() || sampleEditor.isInBoundsSelection() || sampleEditor.isRecordingMode() || fileDragging);
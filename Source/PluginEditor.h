@@ -143,14 +143,15 @@ private:
     JustaSampleAudioProcessor& p;
     PluginParameters::State& pluginState;
     UIDummyParam dummyParam;
-    const juce::OwnedArray<CustomSamplerVoice>& synthVoices;
+    const juce::Array<CustomSamplerVoice*>& synthVoices;
     bool currentlyPlaying{ false };
 
     /** Some thought is needed to keep the editor synchronized when changes to the sample occur
-        or files are loaded. I decided the easiest way is to have the processor and editor both
-        keep track of the buffer's hash.
+        or files are loaded. The processor counts the samples it loads, and the editor keeps track
+        of the last one it showed. A sample's hash isn't known until it has finished loading.
     */
-    juce::String expectedHash{ 0 };
+    int expectedSampleVersion{ -1 };
+    int displayedLength{ 0 };  // How much of the sample was loaded when the waveform was last updated
 
     bool userDraggedSample{ false };  // We use this to reset the UI only when a sample loads as result of a user selection
 
@@ -237,10 +238,14 @@ private:
     juce::Label helpText;
     CustomToggleableButton preFXButton;
     APVTS::ButtonAttachment preFXAttachment;
+    CustomToggleableButton sharedFXButton;
+    APVTS::ButtonAttachment sharedFXAttachment;
+    CustomToggleableButton freezeBungeeButton;
+    APVTS::ButtonAttachment freezeBungeeAttachment;
     CustomToggleableButton showFXButton;
     ToggleButtonAttachment showFXAttachment, darkModeAttachment;
-    juce::ParameterAttachment eqEnablementAttachment, reverbEnablementAttachment, distortionEnablementAttachment, chorusEnablementAttachment;
-    bool eqEnabled{ false }, reverbEnabled{ false }, distortionEnabled{ false }, chorusEnabled{ false };
+    juce::ParameterAttachment eqEnablementAttachment, reverbEnablementAttachment, distortionEnablementAttachment, chorusEnablementAttachment, sharedFXEnablementAttachment;
+    bool eqEnabled{ false }, reverbEnabled{ false }, distortionEnabled{ false }, chorusEnabled{ false }, sharedFXEnabled{ false };
 
     Prompt prompt;
 
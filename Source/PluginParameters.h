@@ -21,6 +21,14 @@
 #define JAS_VST3_REAPER_INTEGRATION false
 #endif
 
+#ifndef JAS_PARALLEL_VOICES
+#define JAS_PARALLEL_VOICES false
+#endif
+
+#ifndef JAS_COMPRESSED_STATE
+#define JAS_COMPRESSED_STATE false
+#endif
+
 /** This namespace contains all APVTS parameter IDs, the other plugin state, various plugin configuration settings, and the parameter layout */
 namespace PluginParameters
 {
@@ -78,10 +86,18 @@ inline static constexpr int FRAME_RATE{ 60 };
 
 inline static constexpr bool REAPER_INTEGRATION_ENABLED{ JAS_VST3_REAPER_INTEGRATION };
 
+/** Whether voices are rendered in parallel on a VoiceRenderPool, whose workers (one for each spare physical core) are shared by every instance */
+inline static constexpr bool PARALLEL_VOICES_ENABLED{ JAS_PARALLEL_VOICES };
+
 // Sample storage
 inline static constexpr bool USE_FILE_REFERENCE{ true };
 inline static constexpr int STORED_BITRATE{ 16 };
 inline static constexpr double MAX_FILE_SIZE{ 320000000.0 }; // in bits, 40MB
+inline static constexpr size_t MIN_STREAMED_BYTES{ size_t(512) * 1024 * 1024 }; // Larger samples are decoded to a file on disk and streamed from it
+/** Whether samples in the plugin state are stored as FLAC instead of WAV, which older versions of the plugin can't load */
+inline static constexpr bool COMPRESSED_STATE_ENABLED{ JAS_COMPRESSED_STATE };
+/** Starts the header of a state with a FLAC sample, before the sizes. Older states start with the APVTS size, which is never negative. */
+inline static constexpr int COMPRESSED_STATE_HEADER{ -2 };
 
 // Tuning
 inline static const String SEMITONE_TUNING{ "Semitone Tuning" };
@@ -119,6 +135,8 @@ enum PLAYBACK_MODES : std::uint8_t
 /** Returns an enum representation of a playback mode given a float */
 inline PLAYBACK_MODES getPlaybackMode(int value) { return static_cast<PLAYBACK_MODES>(value); }
 
+inline static const String FREEZE_BUNGEE{ "Freeze Bungee" };  // Render each key's BUNGEE playback ahead of time, up to 256 MB for each plugin instance
+
 /** Skipping antialiasing can be an interesting effect */
 inline static const String SKIP_ANTIALIASING{ "Lo-fi Resampling" };
 
@@ -197,6 +215,7 @@ enum FxTypes : std::uint8_t
 };
 
 inline static const String PRE_FX{ "FX Before Envelope" };
+inline static const String SHARED_FX{ "Shared FX" };  // Run one FX chain on the mixed output instead of one per voice
 inline static constexpr float FX_TAIL_OFF_MAX{ 0.0001f };  // The cutoff RMS value for tailing off effects
 
 //==============================================================================
@@ -259,6 +278,7 @@ namespace Version
     constexpr int V1_2 = 102;
     constexpr int V1_3 = 1030;
     constexpr int V1_3_2 = 1032;
+    constexpr int V1_4 = 1040;
 }
 
 /** Utility to add an integer parameter to the layout */
@@ -373,6 +393,7 @@ inline juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout
 
     addBool(layout, SKIP_ANTIALIASING, false, Version::V1);
     addChoice(layout, PLAYBACK_MODE, 0, PLAYBACK_MODE_LABELS, Version::V1);
+    addBool(layout, FREEZE_BUNGEE, false, Version::V1_4);
     addFloat(layout, SPEED_FACTOR, 1.f, addSkew({ 0.01f, 5.f, 0.01f }, 1.f), Version::V1, suffixF(SPEED_UNIT, 0.01f));
     addFloat(layout, OCTAVE_SPEED_FACTOR, 0.f, { 0.f, 0.6f, 0.15f }, Version::V1, suffixF(SPEED_UNIT, 0.15f));
     addBool(layout, DISABLE_WAVETABLE_MODE, false, Version::V1_3);
@@ -396,6 +417,7 @@ inline juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout
 
     addInt(layout, FX_PERM, permToParam({ DISTORTION, CHORUS, REVERB, EQ }), { 0, 23 }, Version::V1, FORMAT_PERM_VALUE);
     addBool(layout, PRE_FX, false, Version::V1);
+    addBool(layout, SHARED_FX, false, Version::V1_4);
 
     addFloat(layout, ATTACK, 1, addSkew(ENVELOPE_TIME_RANGE, 1000.f), Version::V1, suffixF(" " + TIME_UNIT, ENVELOPE_TIME_RANGE.interval));
     addFloat(layout, RELEASE, 1, addSkew(ENVELOPE_TIME_RANGE, 1000.f), Version::V1, suffixF(" " + TIME_UNIT, ENVELOPE_TIME_RANGE.interval));
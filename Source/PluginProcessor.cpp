@@ -28,7 +28,6 @@ JustaSampleAudioProcessor::JustaSampleAudioProcessor()
 #endif
     ),
     apvts(*this, &undoManager, "Parameters", PluginParameters::createParameterLayout()),
-    samplerSound(apvts, pluginState, sampleBuffer, int(bufferSampleRate)),
     fileFilter("", {}, {}),
     deviceRecorder(deviceManager)
 #endif
@@ -40,13 +39,25 @@ JustaSampleAudioProcessor::JustaSampleAudioProcessor()
     fileFilter = juce::WildcardFileFilter(formatManager.getWildcardForAllFormats(), {}, {});
 
     mtsClient = MTS_RegisterClient();
+
+    startTimer(TIMER_INTERVAL);
 }
 
 JustaSampleAudioProcessor::~JustaSampleAudioProcessor()
 {
+    // A sample that's still loading is written to until the loader stops
+    sampleLoader.cancel();
+
     for (int i = synth.getNumVoices() - 1; i >= 0; i--)
         synth.removeVoiceWithoutDeleting(i);
 
+    stopTimer();
+    delete pendingSample.exchange(nullptr);
+    delete activeSample;
+    delete fadingSample;
+    latestSample = nullptr;
+    timerCallback();
+
     MTS_DeregisterClient(mtsClient);
 }
 
@@ -122,10 +133,13 @@ juce::VST3ClientExtensions* JustaSampleAudioProcessor::getVST3ClientExtensions()
     return nullptr;
 }
 
-void JustaSampleAudioProcessor::prepareToPlay(double sampleRate, int /*maximumExpectedSamplesPerBlock*/)
+void JustaSampleAudioProcessor::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock)
 {
     juce::ScopedLock lock(voiceLock);
 
+    synth.setParallelRendering(PluginParameters::PARALLEL_VOICES_ENABLED, sampleRate, maximumExpectedSamplesPerBlock,
+        getTotalNumOutputChannels(), PluginParameters::MAX_VOICES);
+
     synth.clearSounds();
     synth.addSound(new BlankSynthesizerSound());
 
@@ -134,15 +148,84 @@ void JustaSampleAudioProcessor::prepareToPlay(double sampleRate, int /*maximumEx
     samplerVoices.clear();
 
     synth.setCurrentPlaybackSampleRate(sampleRate);
+    fadeBuffer.setSize(getTotalNumOutputChannels(), maximumExpectedSamplesPerBlock);
 
-    for (int i = 0; i < PluginParameters::MAX_VOICES; i++)
+    // Processing has stopped, so a pending sample can be adopted (and the previous ones deleted) right away
+    delete fadingSample;
+    fadingSample = nullptr;
+    if (auto* loaded = pendingSample.exchange(nullptr))
+    {
+        delete activeSample;
+        activeSample = loaded;
+    }
+
+    if (activeSample)
+    {
+        createVoices(*activeSample, sampleRate, getBlockSize());
+        setSampleView(*activeSample);
+    }
+}
+
+void JustaSampleAudioProcessor::createVoices(LoadedSample& loaded, double sampleRate, int blockSize) const
+{
+    if (loaded.readAhead)
+        loaded.readAhead->stop();
+
+    loaded.voices.clear();
+    loaded.voices.ensureStorageAllocated(PluginParameters::MAX_VOICES);
+    loaded.numVoices = 0;
+    loaded.playbackRate = sampleRate;
+    loaded.blockSize = blockSize;
+    loaded.stretchers.prepare(int(sampleRate));
+    loaded.freezeCache.prepare(int(sampleRate));
+    addVoices(loaded, p(PluginParameters::NUM_VOICES));
+
+    loaded.fxBus = std::make_unique<FxBus>(loaded.sound, getTotalNumOutputChannels(), int(sampleRate), blockSize > 0 ? blockSize : 512);
+
+    if (loaded.readAhead)
+        loaded.readAhead->start();
+}
+
+void JustaSampleAudioProcessor::addVoices(LoadedSample& loaded, int numVoices) const
+{
+    const bool initializeSample = loaded.sound.sampleRate > 0 && loaded.sample.getNumSamples() > 0;
+    for (int i = loaded.voices.size(); i < juce::jlimit(1, PluginParameters::MAX_VOICES, numVoices); i++)
     {
-        const bool initializeSample = samplerSound.sampleRate > 0 && samplerSound.sample.getNumSamples() > 0;
-        auto* voice = new CustomSamplerVoice(samplerSound, mtsClient, sampleRate, getBlockSize(), initializeSample);
-        samplerVoices.add(voice);
+        loaded.voices.add(new CustomSamplerVoice(loaded.sound, loaded.stretchers, loaded.freezeCache, mtsClient, loaded.playbackRate, loaded.blockSize, initializeSample));
+        loaded.numVoices.store(loaded.voices.size(), std::memory_order_release);
     }
 }
 
+void JustaSampleAudioProcessor::setSampleView(LoadedSample& loaded)
+{
+    if (loaded.sample.getNumChannels() > 0)
+        sampleBuffer.setDataToReferTo(loaded.sample.getArrayOfWritePointers(), loaded.sample.getNumChannels(), loaded.sample.getNumSamples());
+    else
+        sampleBuffer.setSize(0, 0);
+    bufferSampleRate = float(loaded.sound.sampleRate);
+
+    samplerVoices.clearQuick();
+    samplerVoices.addArray(loaded.voices.begin(), loaded.voices.size());
+    latestSample = &loaded;
+    allocateVoiceResources();
+}
+
+void JustaSampleAudioProcessor::allocateVoiceResources()
+{
+    if (!latestSample || latestSample->sample.getNumChannels() == 0)
+        return;
+
+    addVoices(*latestSample, p(PluginParameters::NUM_VOICES));
+    for (int i = samplerVoices.size(); i < latestSample->voices.size(); i++)
+        samplerVoices.add(latestSample->voices[i]);
+
+    const int numVoices = juce::jmin<int>(latestSample->voices.size(), p(PluginParameters::NUM_VOICES));
+    for (int i = 0; i < numVoices; i++)
+        latestSample->voices[i]->allocateEffects();
+    latestSample->stretchers.reserve(StretcherPool::getRequiredSize(latestSample->sound, numVoices),
+        StretcherPool::getRequiredOctaves(latestSample->sound, mtsClient));
+}
+
 void JustaSampleAudioProcessor::releaseResources()
 {
     // When playback stops, this is a place to clean up resources
@@ -175,17 +258,33 @@ void JustaSampleAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, j
         }
     }
 
-    if (sampleBuffer.getNumSamples() == 0 || sampleBuffer.getNumChannels() == 0)
-        return;
-
     juce::ScopedTryLock lock(voiceLock);
 
     if (lock.isLocked())
     {
+        adoptPendingSample();
+        if (!activeSample || activeSample->sample.getNumSamples() == 0 || activeSample->sample.getNumChannels() == 0)
+        {
+            mixFadingSample(buffer);
+            return;
+        }
+
         adjustVoiceCount();
+        activeSample->sound.loopSplice.update();
 
         synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
 
+        // The voices that were removed from the synth keep playing until they've faded out
+        for (int i = synth.getNumVoices(); i < activeSample->getNumVoices(); i++)
+            activeSample->getVoice(i)->renderFadeOut(buffer, buffer.getNumSamples());
+
+        if (activeSample->sound.sharedFX->get())
+            activeSample->fxBus->process(buffer, buffer.getNumSamples());
+        else
+            activeSample->fxBus->bypass();
+
+        mixFadingSample(buffer);
+
 #if JUCE_DEBUG
         for (int ch = 0; ch < buffer.getNumChannels(); ch++)
         {
@@ -202,13 +301,15 @@ void JustaSampleAudioProcessor::adjustVoiceCount(int count)
         numVoices = count;
     int currentVoices = synth.getNumVoices();
 
-    // We never need to instantiate new voices
+    // The timer creates the voices that are missing, until then we make do with fewer
+    numVoices = juce::jmin(numVoices, activeSample->getNumVoices());
+
     if (currentVoices > numVoices)
     {
         for (int i = currentVoices - 1; i >= numVoices; --i)
         {
             synth.removeVoiceWithoutDeleting(i);
-            samplerVoices[i]->immediateHalt();
+            activeSample->getVoice(i)->fadeOut();
         }
     }
   
@@ -216,11 +317,88 @@ void JustaSampleAudioProcessor::adjustVoiceCount(int count)
     {
         for (int i = currentVoices; i < numVoices; ++i)
         {
-            synth.addVoice(samplerVoices[i]);
+            synth.addVoice(activeSample->getVoice(i));
         }
     }
 }
 
+void JustaSampleAudioProcessor::adoptPendingSample()
+{
+    // Only one sample fades out at a time, so the next one waits until the previous one is retired
+    if (pendingSample.load() == nullptr || fadingSample)
+        return;
+
+    for (int i = synth.getNumVoices() - 1; i >= 0; i--)
+        synth.removeVoiceWithoutDeleting(i);
+
+    // The previous voices fade out over the next few blocks instead of stopping abruptly
+    if (activeSample)
+    {
+        for (int i = 0; i < activeSample->getNumVoices(); i++)
+            activeSample->getVoice(i)->fadeOut();
+        fadingSample = activeSample;
+        fadeLength = fadeRemaining = juce::jmax(1, int(CustomSamplerVoice::FADE_OUT_MS * getSampleRate() / 1000.));
+    }
+
+    activeSample = pendingSample.exchange(nullptr);
+}
+
+void JustaSampleAudioProcessor::mixFadingSample(juce::AudioBuffer<float>& buffer)
+{
+    if (!fadingSample)
+        return;
+
+    // The voices fade themselves out, the ramp here is for the tails of the shared FX
+    const int numSamples = buffer.getNumSamples();
+    if (numSamples <= fadeBuffer.getNumSamples())
+    {
+        fadeBuffer.clear();
+        for (int i = 0; i < fadingSample->getNumVoices(); i++)
+            fadingSample->getVoice(i)->renderFadeOut(fadeBuffer, numSamples);
+
+        if (fadingSample->sound.sharedFX->get())
+            fadingSample->fxBus->process(fadeBuffer, numSamples);
+
+        const int rampSamples = juce::jmin(numSamples, fadeRemaining);
+        const float startGain = float(fadeRemaining) / float(fadeLength);
+        fadeRemaining -= rampSamples;
+        for (int ch = 0; ch < juce::jmin(buffer.getNumChannels(), fadeBuffer.getNumChannels()); ch++)
+        {
+            fadeBuffer.applyGainRamp(ch, 0, rampSamples, startGain, float(fadeRemaining) / float(fadeLength));
+            buffer.addFrom(ch, 0, fadeBuffer, ch, 0, rampSamples);
+        }
+    }
+    else
+    {
+        // A block larger than prepared for can't be faded without allocating, so the sample stops abruptly as it used to
+        fadeRemaining = 0;
+    }
+
+    if (fadeRemaining > 0)
+        return;
+
+    for (int i = 0; i < fadingSample->getNumVoices(); i++)
+        fadingSample->getVoice(i)->immediateHalt();
+
+    // If there's no room to retire it yet, it's silent until there is
+    if (retiredSamples.try_enqueue(fadingSample))
+        fadingSample = nullptr;
+}
+
+void JustaSampleAudioProcessor::timerCallback()
+{
+    LoadedSample* retired{ nullptr };
+    while (retiredSamples.try_dequeue(retired))
+        delete retired;
+
+    // The voices in use are created, and get their effects and stretchers, soon after they're needed. The audio thread does without until then.
+    allocateVoiceResources();
+
+    // FREEZE_BUNGEE only renders in the background while it's on
+    if (latestSample)
+        latestSample->freezeCache.update();
+}
+
 //==============================================================================
 void JustaSampleAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
@@ -244,11 +422,20 @@ void JustaSampleAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
     spv(PluginParameters::State::SHOW_FX) = pluginState.showFX.load();
     spv(PluginParameters::State::DARK_MODE) = pluginState.darkMode.load();
 
+    // If we're not using a file reference, the sample is stored too (it was already encoded in the background). A sample that's
+    // still loading has no hash yet, and the rest of it is silence, so it's left out and its file is loaded again instead when the
+    // state is restored.
+    SharedSample::Encoded encodedSample;
+    if (!pluginState.usingFileReference && latestSample && latestSample->data->hash.isNotEmpty())
+        encodedSample = latestSample->data->getEncoded(PluginParameters::COMPRESSED_STATE_ENABLED, PluginParameters::STORED_BITRATE);
+
     // Then, write empty "header" information to the stream
     size_t initialSize{ 0 };
     size_t apvtsSize{ 0 };
     {
         auto apvtsMos = juce::MemoryOutputStream{ destData, true };
+        if (encodedSample.compressed)
+            apvtsMos.writeInt(PluginParameters::COMPRESSED_STATE_HEADER);
         apvtsMos.writeInt(0);  // apvts size
         apvtsMos.writeInt(0);  // sample size
         initialSize = apvtsMos.getDataSize();
@@ -257,41 +444,33 @@ void JustaSampleAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
         apvtsSize = apvtsMos.getDataSize() - initialSize;
     }
 
-    size_t sampleSize = 0;
-
-    // If we're not using a file reference, write the sample buffer to the stream
-    if (!pluginState.usingFileReference && sampleBuffer.getNumSamples())
-    {
-        juce::WavAudioFormat wavFormat;
-        auto options = juce::AudioFormatWriterOptions{}
-            .withSampleRate(bufferSampleRate)
-            .withNumChannels(sampleBuffer.getNumChannels())
-            .withBitsPerSample(PluginParameters::STORED_BITRATE);
-
-        std::unique_ptr<juce::OutputStream> stream = std::make_unique<juce::MemoryOutputStream>(destData, true);
-        auto formatWriter = wavFormat.createWriterFor(stream, options);
-        formatWriter->writeFromAudioSampleBuffer(sampleBuffer, 0, sampleBuffer.getNumSamples());
-        formatWriter.reset();
-        sampleSize = destData.getSize() - apvtsSize - initialSize;
-    }
+    size_t sampleSize = encodedSample.data ? encodedSample.data->getSize() : 0;
+    if (sampleSize)
+        destData.append(encodedSample.data->getData(), sampleSize);
 
     // Write the header
     auto headerMos = juce::MemoryOutputStream{ destData, true };
     headerMos.setPosition(0);
+    if (encodedSample.compressed)
+        headerMos.writeInt(PluginParameters::COMPRESSED_STATE_HEADER);
     headerMos.writeInt(int(apvtsSize));
     headerMos.writeInt(int(sampleSize));
 }
 
 void JustaSampleAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    // First, read the header information which includes the sizes of the APVTS and sample buffer
+    // First, read the header information which includes the sizes of the APVTS and sample buffer, and whether the sample is FLAC
     juce::MemoryInputStream mis(data, sizeInBytes, false);
-    size_t apvtsSize = mis.readInt();
+    int firstInt = mis.readInt();
+    const bool compressed = firstInt == PluginParameters::COMPRESSED_STATE_HEADER;
+    size_t apvtsSize = size_t(compressed ? mis.readInt() : firstInt);
     size_t sampleSize = mis.readInt();
 
-    if (size_t(sizeInBytes) != apvtsSize + sampleSize + 8)
+    if (size_t(sizeInBytes) != apvtsSize + sampleSize + size_t(mis.getPosition()))
         return; // format issue
 
+    const juce::int64 sampleOffset = mis.getPosition() + juce::int64(apvtsSize);
+
     // Read the APVTS
     juce::SubregionStream apvtsStream{ &mis, mis.getPosition(), juce::int64(apvtsSize), false };
     auto tree = juce::ValueTree::readFromStream(apvtsStream);
@@ -326,7 +505,8 @@ void JustaSampleAudioProcessor::setStateInformation(const void* data, int sizeIn
                 pluginState.loopEnd = loopEnd;
             };
 
-        bool newFile = pluginState.sampleHash != sp(PluginParameters::State::SAMPLE_HASH).toString();
+        // A state saved while the sample was still loading has no hash and no stored sample, so the file is loaded again without checking it
+        bool newFile = pluginState.sampleHash != sp(PluginParameters::State::SAMPLE_HASH).toString() || sp(PluginParameters::State::SAMPLE_HASH).toString().isEmpty();
         if (!newFile)
             updateFileInfo();
 
@@ -343,7 +523,8 @@ void JustaSampleAudioProcessor::setStateInformation(const void* data, int sizeIn
 
         // Either load the sample from the file reference or from the stream directly
         juce::String filePath = pluginState.filePath;
-        if (pluginState.usingFileReference && filePath.isNotEmpty() && newFile)
+        const bool savedWhileLoading = !sampleSize && sampleHash.toString().isEmpty();
+        if ((pluginState.usingFileReference || savedWhileLoading) && filePath.isNotEmpty() && newFile)
         {
             loadSampleFromPath(filePath, false, sampleHash, false, [this, filePath, updateFileInfo, sampleHash](bool fileLoaded) -> void
                 {
@@ -362,53 +543,77 @@ void JustaSampleAudioProcessor::setStateInformation(const void* data, int sizeIn
         }
         else if (sampleSize && newFile)
         {
-            // A copy must be made to allow reading in another thread, outside the lifetime of this function
-            auto sampleData = std::make_shared<juce::MemoryBlock>(sampleSize);
-            mis.read(sampleData->getData(), int(sampleSize));
-            auto wavStream = new juce::MemoryInputStream(*sampleData, false);
-
-            juce::WavAudioFormat wavFormat;
-            std::unique_ptr<juce::AudioFormatReader> wavFormatReader{ wavFormat.createReaderFor(wavStream, true) };
-            if (wavFormatReader)
+            // Another instance might already have the stored sample, so it doesn't need to be decoded again
+            if (auto cached = sampleCache->find(sampleHash.toString()))
             {
                 lastLoadAttempt = "";
                 reaperExtensions.setNamedConfigParam(REAPER_FILE_PATH, "");
-                sampleLoader.loadSample(std::move(wavFormatReader), [this, sampleData /* necessary capture */, updateFileInfo, sampleHash]
-                (const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String&, const std::unique_ptr<juce::AudioFormatReader>& reader) -> void
+                sampleLoader.loadCached([this, cached, updateFileInfo]
                     {
-                        if (!reader)
-                            return;
-
-                        loadSample(*loadedSample, int(reader->sampleRate), false, sampleHash);
-
+                        loadSample(cached, false);
                         updateFileInfo();
                     });
             }
+            else
+            {
+                // A copy must be made to allow reading in another thread, outside the lifetime of this function. It's kept as the
+                // sample's encoded data (see SharedSample::setEncoded), so it's the only one.
+                auto sampleData = std::make_shared<juce::MemoryBlock>(static_cast<const char*>(data) + sampleOffset, sampleSize);
+                auto sampleStream = new juce::MemoryInputStream(*sampleData, false);
+
+                juce::FlacAudioFormat flacFormat;
+                juce::WavAudioFormat wavFormat;
+                juce::AudioFormat& format = compressed ? static_cast<juce::AudioFormat&>(flacFormat) : wavFormat;
+                std::unique_ptr<juce::AudioFormatReader> formatReader{ format.createReaderFor(sampleStream, true) };
+                if (formatReader)
+                {
+                    lastLoadAttempt = "";
+                    reaperExtensions.setNamedConfigParam(REAPER_FILE_PATH, "");
+                    sampleLoader.loadSample(std::move(formatReader), getHashFormat(sampleHash), [this, sampleData /* necessary capture */, compressed, updateFileInfo, sampleHash]
+                    (const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String&, const std::unique_ptr<juce::AudioFormatReader>& reader, std::unique_ptr<MappedBuffer> mappedSample) -> void
+                        {
+                            if (!reader)
+                                return;
+
+                            // The stored data doesn't need to be encoded again when the state is saved
+                            auto sample = std::make_shared<SharedSample>(std::move(*loadedSample), int(reader->sampleRate), std::move(mappedSample));
+                            sample->hash = sampleHash.toString();
+                            sample->setEncoded(sampleData, compressed, PluginParameters::STORED_BITRATE);
+                            loadSample(sample, false);
+
+                            updateFileInfo();
+                        });
+                }
+            }
         }
     }
 }
 
 //==============================================================================
-void JustaSampleAudioProcessor::loadSample(juce::AudioBuffer<float>& sample, int sampleRate, bool resetParameters, const juce::String& precomputedHash)
+void JustaSampleAudioProcessor::loadSample(std::shared_ptr<SharedSample> sample, bool resetParameters, bool isLoading)
 {
-    juce::ScopedLock lock(voiceLock);
-
-    haltVoices();
+    // Everything is prepared here, while the audio thread keeps playing the previous sample with the bounds it has
+    if (latestSample)
+        latestSample->sound.stopFollowingBounds();
+    auto* loaded = new LoadedSample(apvts, pluginState, std::move(sample), mtsClient);
 
-    sampleBuffer = std::move(sample);
-    bufferSampleRate = float(sampleRate);
-
-    if (precomputedHash.isNotEmpty())
-        pluginState.sampleHash = precomputedHash;
+    if (isLoading)
+    {
+        pluginState.sampleHash = "";  // Set by sampleFinishedLoading()
+    }
     else
-        pluginState.sampleHash = getSampleHash(sampleBuffer);
+    {
+        if (loaded->data->hash.isEmpty())
+            loaded->data->hash = getSampleHash(loaded->sample);
+        pluginState.sampleHash = loaded->data->hash;
+    }
 
     if (resetParameters)
     {
-        pluginState.usingFileReference = sampleBufferNeedsReference();
+        pluginState.usingFileReference = sampleBufferNeedsReference(loaded->sample);
 
         pluginState.sampleStart = 0;
-        pluginState.sampleEnd = sampleBuffer.getNumSamples() - 1;
+        pluginState.sampleEnd = loaded->sample.getNumSamples() - 1;
 
         // The order here is actually important, because the start and end buttons can otherwise enable the main loop button
         pv(PluginParameters::LOOPING_HAS_START) = false;
@@ -416,17 +621,79 @@ void JustaSampleAudioProcessor::loadSample(juce::AudioBuffer<float>& sample, int
         pv(PluginParameters::IS_LOOPING) = false;
 
         pluginState.loopStart = 0;
-        pluginState.loopEnd = sampleBuffer.getNumSamples() - 1;
+        pluginState.loopEnd = loaded->sample.getNumSamples() - 1;
     }
 
-    samplerSound.sampleChanged(int(bufferSampleRate));
-    for (const auto& voice : samplerVoices)
-        voice->initializeSample();
+    if (!isLoading)
+    {
+        loaded->data->sampleLoaded();
+        shareSample(loaded->data);
+    }
+    loaded->sound.sampleChanged(loaded->data->sampleRate, isLoading);
+
+    createVoices(*loaded, getSampleRate(), getBlockSize());
+    setSampleView(*loaded);
+    sampleVersion++;
+
+    // A sample that was loaded before but never adopted can be deleted right away, since the audio thread hasn't seen it
+    delete pendingSample.exchange(loaded);
+}
+
+int JustaSampleAudioProcessor::getLoadedLength() const
+{
+    const int progress = sampleLoader.getProgress();
+    return progress >= 0 ? progress : sampleBuffer.getNumSamples();
+}
+
+void JustaSampleAudioProcessor::sampleFinishedLoading(const juce::String& sampleHash)
+{
+    // Loading anything else cancels the loader first, so the latest sample is the one that finished
+    pluginState.sampleHash = sampleHash;
+    if (latestSample)
+    {
+        latestSample->data->hash = sampleHash;
+        latestSample->data->sampleLoaded();
+        latestSample->sound.sampleLoaded();
+        shareSample(latestSample->data);
+    }
+}
+
+void JustaSampleAudioProcessor::shareSample(const std::shared_ptr<SharedSample>& sample)
+{
+    sampleCache->add(sample);
+    if (!pluginState.usingFileReference)
+        sampleCache->encodeInBackground(sample, PluginParameters::COMPRESSED_STATE_ENABLED, PluginParameters::STORED_BITRATE);
 }
 
 void JustaSampleAudioProcessor::loadSampleFromPath(const juce::String& path, bool resetParameters, const juce::String& expectedHash, bool continueWithWrongHash, const std::function<void(bool)>& callback)
 {
     const juce::File file{ path };
+
+    // Another instance might have the expected sample or this file loaded already. The hash of a sample from the file can only be
+    // checked if it was computed the same way as the expected one.
+    auto cached = sampleCache->find(expectedHash);
+    if (!cached)
+        cached = sampleCache->find(file);
+    if (cached && expectedHash.isNotEmpty() && getHashFormat(cached->hash) != getHashFormat(expectedHash))
+        cached = nullptr;
+
+    if (cached)
+    {
+        lastLoadAttempt = path;
+        reaperExtensions.setNamedConfigParam(REAPER_FILE_PATH, "");
+        sampleLoader.loadCached([this, cached, callback, path, expectedHash, continueWithWrongHash, resetParameters]
+            {
+                const bool wrongHash = expectedHash.isNotEmpty() && cached->hash != expectedHash;
+                if (wrongHash && !continueWithWrongHash)
+                    return callback(false);
+
+                pluginState.filePath = path;
+                loadSample(cached, resetParameters || wrongHash);
+                callback(true);
+            });
+        return;
+    }
+
     std::unique_ptr<juce::AudioFormatReader> formatReader{ formatManager.createReaderFor(file) };
 
     if (!formatReader || !formatReader->lengthInSamples)
@@ -435,18 +702,37 @@ void JustaSampleAudioProcessor::loadSampleFromPath(const juce::String& path, boo
     lastLoadAttempt = path;
     reaperExtensions.setNamedConfigParam(REAPER_FILE_PATH, "");
 
-    // Load the file and check the hash
-    sampleLoader.loadSample(std::move(formatReader), [this, callback, path, expectedHash, continueWithWrongHash, resetParameters]
-        (const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String& sampleHash, const std::unique_ptr<juce::AudioFormatReader>& reader) -> void
+    // Without a hash to check, the sample can play as soon as its head is loaded
+    std::function<void(const std::unique_ptr<juce::AudioBuffer<float>>&, double, std::unique_ptr<MappedBuffer>)> onHeadLoaded;
+    if (expectedHash.isEmpty())
+        onHeadLoaded = [this, file, continueWithWrongHash, resetParameters]
+            (const std::unique_ptr<juce::AudioBuffer<float>>& loadingSample, double sampleRate, std::unique_ptr<MappedBuffer> mappedSample) -> void
+            {
+                pluginState.filePath = file.getFullPathName();
+                loadSample(std::make_shared<SharedSample>(std::move(*loadingSample), int(sampleRate), std::move(mappedSample), file), resetParameters || continueWithWrongHash, true);
+            };
+
+    // Load the file and check the hash, computed the same way as the expected one
+    const auto hashFormat = expectedHash.isNotEmpty() ? getHashFormat(expectedHash) : getDefaultHashFormat();
+    sampleLoader.loadSample(std::move(formatReader), hashFormat, [this, callback, file, expectedHash, continueWithWrongHash, resetParameters]
+        (const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String& sampleHash, const std::unique_ptr<juce::AudioFormatReader>& reader, std::unique_ptr<MappedBuffer> mappedSample) -> void
         {
+            if (!loadedSample)  // It was already handed over by onHeadLoaded
+            {
+                sampleFinishedLoading(sampleHash);
+                return callback(true);
+            }
+
             if (expectedHash.isNotEmpty() && sampleHash != expectedHash && !continueWithWrongHash)
                 return callback(false);
 
-            pluginState.filePath = path;
-            loadSample(*loadedSample, int(reader->sampleRate), resetParameters || (sampleHash != expectedHash && continueWithWrongHash), sampleHash);
+            auto sample = std::make_shared<SharedSample>(std::move(*loadedSample), int(reader->sampleRate), std::move(mappedSample), file);
+            sample->hash = sampleHash;
+            pluginState.filePath = file.getFullPathName();
+            loadSample(sample, resetParameters || (sampleHash != expectedHash && continueWithWrongHash));
 
             return callback(true);
-        });
+        }, onHeadLoaded);
 }
 
 //==============================================================================
@@ -472,9 +758,10 @@ void JustaSampleAudioProcessor::openFileChooser(const juce::String& message, int
 
 void JustaSampleAudioProcessor::haltVoices()
 {
-    for (auto voice : samplerVoices)
+    // The voices may be rendering, so they halt on the audio thread
+    for (auto* voice : samplerVoices)
     {
-        voice->immediateHalt();
+        voice->requestHalt();
     }
 }
 
@@ -527,7 +814,8 @@ void JustaSampleAudioProcessor::recordingFinished(juce::AudioBuffer<float> recor
         pluginState.filePath = "";
         lastLoadAttempt = "";
         reaperExtensions.setNamedConfigParam(REAPER_FILE_PATH, "");
-        loadSample(recordingBuffer, recordingSampleRate, true);
+        sampleLoader.cancel();
+        loadSample(std::make_shared<SharedSample>(std::move(recordingBuffer), recordingSampleRate), true);
     }
 }
 
@@ -25,13 +25,15 @@
 #include "CustomLookAndFeel.h"
 #include "Sampler/CustomSamplerVoice.h"
 #include "Sampler/CustomSynthesizer.h"
+#include "Sampler/LoadedSample.h"
 #include "Utilities/PitchDetector.h"
 #include "Utilities/DeviceRecorder.h"
 #include "Utilities/Reaper/ReaperVST3Extensions.h"
 #include "Utilities/SampleLoader.h"
 #include <libMTSClient.h>
+#include <readerwriterqueue.h>
 
-class JustaSampleAudioProcessor final : public juce::AudioProcessor, public juce::Thread::Listener, public DeviceRecorderListener
+class JustaSampleAudioProcessor final : public juce::AudioProcessor, public juce::Thread::Listener, public DeviceRecorderListener, private juce::Timer
 #if JucePlugin_Enable_ARA
     , public juce::AudioProcessorARAExtension
 #endif
@@ -71,7 +73,11 @@ public:
     //==============================================================================
     const juce::AudioBuffer<float>& getSampleBuffer() const { return sampleBuffer; }
     float getBufferSampleRate() const { return bufferSampleRate; }
-    const juce::OwnedArray<CustomSamplerVoice>& getSamplerVoices() const { return samplerVoices; }
+    const juce::Array<CustomSamplerVoice*>& getSamplerVoices() const { return samplerVoices; }
+    /** Changes whenever a new sample is loaded, so the Editor knows to show it */
+    int getSampleVersion() const { return sampleVersion; }
+    /** How much of the sample buffer is loaded, only less than its length while the rest of a large sample is loading */
+    int getLoadedLength() const;
 
     /** The APVTS is the central object storing plugin state and audio processing parameters. See PluginParameters.h. */
     juce::AudioProcessorValueTreeState& APVTS() { return apvts; }
@@ -127,21 +133,53 @@ private:
     /** Add or subtract voices if necessary */
     void adjustVoiceCount(int count = -1);
 
+    /** Called by the audio thread at the start of a block to switch to a newly loaded sample, if there is one */
+    void adoptPendingSample();
+
+    /** Adds the previous sample's voices to the block while they fade out after a switch, then retires the sample */
+    void mixFadingSample(juce::AudioBuffer<float>& buffer);
+
+    /** Creates the voices NUM_VOICES needs and the FxBus for a loaded sample, prepared for the given playback sample rate and block size */
+    void createVoices(LoadedSample& loaded, double sampleRate, int blockSize) const;
+
+    /** Adds voices to a loaded sample until it has numVoices, they can be added while the audio thread plays it */
+    void addVoices(LoadedSample& loaded, int numVoices) const;
+
+    /** Creates the voices NUM_VOICES needs for the latest sample, and allocates the enabled effects and the stretchers for them,
+        so the audio thread never has to
+    */
+    void allocateVoiceResources();
+
+    /** Points sampleBuffer and samplerVoices (which the Editor references) to a loaded sample */
+    void setSampleView(LoadedSample& loaded);
+
+    /** Deletes the samples that the audio thread has retired, and allocates what newly enabled effects or stretching need */
+    void timerCallback() override;
+
     //==============================================================================
     /** The plugin's state information includes the full APVTS (with non-parameter values) and audio data if a file 
-        reference is not being used.
+        reference is not being used. The audio data is encoded in the background once the sample is loaded (see
+        SharedSample::getEncoded), so saving the state is mostly just writing the APVTS.
     */
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
     //==============================================================================
-    /** Loads an audio buffer into the synth, preparing everything for playback. If 
+    /** Loads a sample into the synth, preparing everything for playback. If 
         resetParameters is true, the plugin's parameters are reset to default, matching
         the new sample. Otherwise, the assumption is that the parameters are in a valid state.
-        Note that this method uses std::move on the sample.
         Also, if necessary, set pluginState.filePath before calling this method, so that the editor syncs correctly.
+        The audio thread keeps playing the previous sample until it adopts the new one, at the start of its next block.
+        A sample without a hash is hashed here, and once it's complete, it's added to the SampleCache for other instances.
+        If isLoading, the SampleLoader is still loading the rest of the sample into it, see sampleFinishedLoading().
      */
-    void loadSample(juce::AudioBuffer<float>& sample, int sampleRate, bool resetParameters = true, const juce::String& precomputedHash = "");
+    void loadSample(std::shared_ptr<SharedSample> sample, bool resetParameters = true, bool isLoading = false);
+
+    /** Completes a sample that was loaded while it was still loading */
+    void sampleFinishedLoading(const juce::String& sampleHash);
+
+    /** Adds a complete sample to the SampleCache, and encodes it for the plugin state if it's stored there */
+    void shareSample(const std::shared_ptr<SharedSample>& sample);
 
     //==============================================================================
     void recordingStarted() override {}
@@ -160,20 +198,40 @@ private:
 
     CustomSynthesizer synth;
 
-    /** Note that this is referenced directly by the Editor. As such, it should only be modified in the Message Thread. */
+    /** Note that this is referenced directly by the Editor. As such, it should only be modified in the Message Thread.
+        It refers to the data of the latest LoadedSample, which might not have been adopted by the audio thread yet.
+    */
     juce::AudioBuffer<float> sampleBuffer;
     float bufferSampleRate{ 0.f };
-    SamplerParameters samplerSound;
-    /** We manage MAX_VOICES for the duration of the plugin and control how many the synth has access to */
-    juce::OwnedArray<CustomSamplerVoice> samplerVoices;
+    int sampleVersion{ 0 };
+    /** The voices of the latest LoadedSample, for the Editor */
+    juce::Array<CustomSamplerVoice*> samplerVoices;
+    /** The latest LoadedSample, which is owned by either pendingSample or activeSample, for the message thread */
+    LoadedSample* latestSample{ nullptr };
     juce::CriticalSection voiceLock;
 
+    /** A LoadedSample is published to pendingSample by the message thread, and adopted as activeSample by the audio thread. Each has
+        as many voices as NUM_VOICES has needed, and we control how many the synth has access to. The previous activeSample fades out,
+        and is then sent back through retiredSamples to be deleted on the message thread, since the audio thread never allocates or
+        frees memory.
+    */
+    std::atomic<LoadedSample*> pendingSample{ nullptr };
+    LoadedSample* activeSample{ nullptr };
+    /** The previous activeSample, while its voices (and shared FX) fade out, before it's retired */
+    LoadedSample* fadingSample{ nullptr };
+    int fadeRemaining{ 0 }, fadeLength{ 1 };  // In samples
+    juce::AudioBuffer<float> fadeBuffer;
+    moodycamel::ReaderWriterQueue<LoadedSample*> retiredSamples{ 16 };
+    static constexpr int TIMER_INTERVAL{ 100 };  // In milliseconds
+
     juce::PluginHostType hostType;
     std::unique_ptr<juce::FileChooser> fileChooser;
     juce::AudioFormatManager formatManager;
     juce::WildcardFileFilter fileFilter;
 
     SampleLoader sampleLoader;
+    /** Shared by every instance in the process */
+    juce::SharedResourcePointer<SampleCache> sampleCache;
     juce::String lastLoadAttempt;
     /** We use this to notify the editor that the sample was loaded from Reaper, since this should be treated as a user load */
     std::atomic<bool> loadedFromReaper{ false };  
@@ -11,51 +11,42 @@
 #include "CustomSamplerVoice.h"
 
 #include "../Utilities/BufferUtils.h"
-#include "Effects/BandEQ.h"
-#include "Effects/Chorus.h"
-#include "Effects/Distortion.h"
-#include "Effects/Reverb.h"
-
-CustomSamplerVoice::CustomSamplerVoice(const SamplerParameters& samplerSound, MTSClient* client, double applicationSampleRate, int expectedBlockSize, bool initSample) :
-    expectedBlockSize(expectedBlockSize), sampleSound(samplerSound),
-    mainStretcher(samplerSound.sample, samplerSound.sampleRate),
-    loopStretcher(samplerSound.sample, samplerSound.sampleRate),
-    endStretcher(samplerSound.sample, samplerSound.sampleRate),
+
+CustomSamplerVoice::CustomSamplerVoice(const SamplerParameters& samplerSound, StretcherPool& stretcherPool, FreezeCache& freezeCache, MTSClient* client, double applicationSampleRate, int expectedBlockSize, bool initSample) :
+    expectedBlockSize(expectedBlockSize > 0 ? expectedBlockSize : 512),  // In case a DAW reports this incorrectly at the time of prepareToPlay
+    sampleSound(samplerSound),
+    stretcherPool(stretcherPool),
+    freezeCache(freezeCache),
+    effects(samplerSound, this->expectedBlockSize),
     mtsClient(client)
 {
     SynthesiserVoice::setCurrentPlaybackSampleRate(applicationSampleRate);
 
-    if (expectedBlockSize <= 0)
-        this->expectedBlockSize = 512;  // In case a DAW reports this incorrectly at the time of prepareToPlay
-
     if (initSample)
         initializeSample();
 }
 
+CustomSamplerVoice::~CustomSamplerVoice()
+{
+    // The pool outlives its voices, and a slot that's never released can't be checked out again
+    releaseStretchers();
+}
+
 void CustomSamplerVoice::initializeSample()
 {
     if (sampleSound.sample.getNumChannels() <= 0)
         return;
 
-    mainStretcher = BungeeStretcher(sampleSound.sample, sampleSound.sampleRate);
-    loopStretcher = BungeeStretcher(sampleSound.sample, sampleSound.sampleRate);
-    endStretcher = BungeeStretcher(sampleSound.sample, sampleSound.sampleRate);
-
-    const int sampleRate = int(getSampleRate());
-    if (sampleRate > 0)
-    {
-        mainStretcher.preallocateStretcher(sampleRate);
-        loopStretcher.preallocateStretcher(sampleRate);
-        endStretcher.preallocateStretcher(sampleRate);
-    }
-
     tempOutputBuffer.setSize(sampleSound.sample.getNumChannels(), expectedBlockSize * 2);
-    envelopeBuffer.setSize(sampleSound.sample.getNumChannels(), expectedBlockSize * 2);
+    envelopeBuffer.setSize(1, expectedBlockSize * 2);
+    fetchPositionBuffer.setSize(NUM_BLOCK_FETCHES, expectedBlockSize * 2);
+    crossfadeGainBuffer.setSize(2 * NUM_BLOCK_FETCHES, expectedBlockSize * 2);
+    interpolationBuffer.setSize(1, expectedBlockSize * 2);
+    segments.resize(size_t(MAX_SEGMENTS_PER_SAMPLE * expectedBlockSize * 2 + 1));
 
     tailOffBuffer.setSize(2, TAIL_OFF, false, true);
-    mainStretcherBuffer.setSize(sampleSound.sample.getNumChannels(), expectedBlockSize * 2);
-    loopStretcherBuffer.setSize(sampleSound.sample.getNumChannels() - 1, expectedBlockSize * 2);
-    endStretcherBuffer.setSize(sampleSound.sample.getNumChannels() - 1, expectedBlockSize * 2);
+    loopStretcherBuffer.setSize(sampleSound.sample.getNumChannels(), expectedBlockSize * 2);
+    endStretcherBuffer.setSize(sampleSound.sample.getNumChannels(), expectedBlockSize * 2);
 
     mainLowpass.clear();
     loopLowpass.clear();
@@ -68,6 +59,12 @@ void CustomSamplerVoice::initializeSample()
     }
 }
 
+void CustomSamplerVoice::allocateEffects()
+{
+    if (!sampleSound.sharedFX->get())
+        effects.allocate(sampleSound.sample.getNumChannels(), int(getSampleRate()));
+}
+
 void CustomSamplerVoice::startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition)
 {
     if (midiNoteNumber < sampleSound.midiStart->get() || midiNoteNumber > sampleSound.midiEnd->get() || MTS_ShouldFilterNote(mtsClient, char(midiNoteNumber), -1))
@@ -77,6 +74,7 @@ void CustomSamplerVoice::startNote(int midiNoteNumber, float velocity, juce::Syn
         noteVelocity = velocity;
     else
         noteVelocity = 1.f;
+    velocityGain = juce::Decibels::decibelsToGain(40 * log10(noteVelocity));  // Standard velocity curve
 
     if (sound)
     {
@@ -99,6 +97,17 @@ void CustomSamplerVoice::startNote(int midiNoteNumber, float velocity, juce::Syn
         effectiveStart = loopingHasStart ? loopStart : sampleStart;
         effectiveEnd = loopingHasEnd ? loopEnd : sampleEnd;
 
+        // If the pool hasn't caught up with the parameters yet, the note plays in BASIC mode instead
+        releaseStretchers();
+        stretcherPool.notePlayed(midiNoteNumber);
+        freezeCache.notePlayed(midiNoteNumber);
+        if (playbackMode == PluginParameters::BUNGEE)
+        {
+            const auto noteTuning = sampleSound.getTuning(midiNoteNumber, currentPitchWheelPosition, mtsClient);
+            if (!checkoutStretchers({ double(effectiveStart), noteTuning.pitch, noteTuning.speed }))
+                playbackMode = PluginParameters::BASIC;
+        }
+
         // While release can be applied before or after the FX, a minimum number of attack smoothing always needs to be applied to the sample before FX
         attackSmoothing = sampleSound.attack->get() * float(getSampleRate()) / 1000.f;
         releaseSmoothing = sampleSound.release->get() * float(getSampleRate()) / 1000.f;
@@ -106,26 +115,43 @@ void CustomSamplerVoice::startNote(int midiNoteNumber, float velocity, juce::Syn
         releaseShape = sampleSound.releaseShape->get();
         if (loopingHasEnd)  // Keep release smoothing within end portion
             releaseSmoothing = juce::jmin<float>(releaseSmoothing, float(loopEnd - sampleEnd));
-        crossfade = juce::jmin<float>(float(sampleSound.crossfadeSamples->get()), (sampleEnd - sampleStart + 1) / 2.f + 1);
+        crossfade = LoopSplice::getCrossfade(sampleStart, sampleEnd, sampleSound.crossfadeSamples->get());
+        crossfadeToIndex = crossfade > 0.f ? CrossfadeTable::RESOLUTION / double(crossfade) : 0.;
 
         vc = VoiceContext();
         midiReleased = false;
+        fadeOutRemaining = 0;
+        haltRequested.store(false, std::memory_order_relaxed);
 
         doLowpass = false;
         vc.currentPosition = effectiveStart;
         updateSpeedAndPitch(midiNoteNumber, currentPitchWheelPosition);
 
-        if (playbackMode == PluginParameters::BUNGEE)
-            mainStretcher.initialize(effectiveStart, tuning, speedFactor);
+        // There's nothing to ramp from at the start of a note
+        snapshotParams();
+        previousParams = params;
 
-        effects.clear();
-        initializeFx();
-        for (auto& effect : effects)
+        if (playbackMode == PluginParameters::BUNGEE)
         {
-            effect.fx->initialize(sampleSound.sample.getNumChannels(), int(getSampleRate()));
-            effect.fx->updateParams(sampleSound);
+            // A frozen note starts out copying the key's render, the main stretcher only plays if the note thaws
+            if (sampleSound.freezeBungee->get())
+                frozenNote = freezeCache.acquire(midiNoteNumber, { double(effectiveStart), FreezeCache::getRenderEnd(sampleEnd, isLooping, crossfade), tuning, speedFactor });
+
+            if (frozenNote != nullptr)
+            {
+                frozenStretcher = mainStretcher;
+                frozenIndex = 0;
+                frozenStep = speed;
+            }
+            else
+            {
+                mainStretcher->initialize(effectiveStart, tuning, speedFactor);
+            }
         }
-     
+
+        // The effects were allocated by allocateEffects(), here they're only marked to be reset before they're next processed
+        effects.updateOrder(sampleSound);
+        effects.disableAll();
         updateFXParamsTimer = 0;
 
         // Set the initial state (vc.currentPosition is set before updateSpeedAndPitch)
@@ -151,49 +177,81 @@ void CustomSamplerVoice::stopNote(float /*velocity*/, bool allowTailOff)
         tailOff = 0;
 
         vc.state = STOPPED;
+        readPosition.store(-1., std::memory_order_relaxed);
+        releaseStretchers();
         clearCurrentNote();
     }
 }
 
 void CustomSamplerVoice::immediateHalt()
 {
+    haltRequested.store(false, std::memory_order_relaxed);
+    fadeOutRemaining = 0;
     vc.state = STOPPED;
+    readPosition.store(-1., std::memory_order_relaxed);
+    releaseStretchers();
     clearCurrentNote();
 }
 
-void CustomSamplerVoice::pitchWheelMoved(int newPitchWheelValue)
+void CustomSamplerVoice::fadeOut()
 {
-    updateSpeedAndPitch(getCurrentlyPlayingNote(), newPitchWheelValue);
+    if (!isVoiceActive())
+        immediateHalt();
+    else if (!isFadingOut())
+        fadeOutRemaining = fadeOutLength = juce::jmax(1, int(FADE_OUT_MS * getSampleRate() / 1000.));
 }
 
-void CustomSamplerVoice::updateSpeedAndPitch(int currentNote, int pitchWheelPosition)
+void CustomSamplerVoice::renderFadeOut(juce::AudioBuffer<float>& outputBuffer, int numSamples)
 {
-    pitchWheel = pitchWheelPosition;
-
-    // Account for tuning adjustments
-    float tuningRatio = 1.f;
-
-    if (playbackMode == PluginParameters::BASIC && wavetableMode)
-        tuningRatio *= std::pow(2.f, (sampleSound.waveformSemitoneTuning->get() + sampleSound.waveformCentTuning->get() / 100.f) / 12.f);
-    else
-        tuningRatio *= std::pow(2.f, (sampleSound.semitoneTuning->get() + sampleSound.centTuning->get() / 100.f) / 12.f);
+    if (!isFadingOut())
+        return;
 
-    float wheelRange = sampleSound.pitchWheelRange->get();
-    tuningRatio *= std::pow(2.f, juce::jmap<float>(float(pitchWheelPosition), 0.f, 16383.f, -wheelRange, wheelRange) / 12.f);
+    renderNextBlock(outputBuffer, 0, numSamples);
+    if (!isVoiceActive())
+        immediateHalt();
+}
 
-    tuningRatio *= std::pow(2.f, sampleSound.wideTuningControl->get() / 12.f);
+bool CustomSamplerVoice::checkoutStretchers(const StretcherPool::WarmTarget& noteStart)
+{
+    mainStretcher = stretcherPool.checkoutWarm(noteStart);
+    if (isLooping)
+        loopStretcher = stretcherPool.checkout();
+    if (loopingHasEnd)
+        endStretcher = stretcherPool.checkout();
 
-    // Account for MIDI note
-    if (sampleSound.followMidiPitch->get())
+    if (mainStretcher && (loopStretcher || !isLooping) && (endStretcher || !loopingHasEnd))
     {
-        int rootNote = sampleSound.midiRoot->get();
-        tuningRatio *= std::pow(2.f, (currentNote - rootNote) / 12.f);
-        tuningRatio *= float(MTS_RetuningAsRatio(mtsClient, char(currentNote), -1));
+        // The pool already cancelled any preroll left over from the stretchers' previous voices, except a warm main stretcher's
+        loopPrerollStarted = false;
+        endPrerollStarted = false;
+        return true;
     }
 
-    tuning = tuningRatio;
-    speedFactor = sampleSound.speedFactor->get();
-    speedFactor *= 1.f + (tuning - 1.f) * sampleSound.octaveSpeedFactor->get();
+    releaseStretchers();
+    return false;
+}
+
+void CustomSamplerVoice::releaseStretchers()
+{
+    frozenStretcher = nullptr;
+    frozenNote = nullptr;
+    stretcherPool.release(std::exchange(mainStretcher, nullptr));
+    stretcherPool.release(std::exchange(loopStretcher, nullptr));
+    stretcherPool.release(std::exchange(endStretcher, nullptr));
+}
+
+void CustomSamplerVoice::pitchWheelMoved(int newPitchWheelValue)
+{
+    updateSpeedAndPitch(getCurrentlyPlayingNote(), newPitchWheelValue);
+}
+
+void CustomSamplerVoice::updateSpeedAndPitch(int currentNote, int pitchWheelPosition)
+{
+    pitchWheel = pitchWheelPosition;
+
+    const auto noteTuning = sampleSound.getTuning(currentNote, pitchWheelPosition, mtsClient, playbackMode == PluginParameters::BASIC && wavetableMode);
+    tuning = noteTuning.pitch;
+    speedFactor = noteTuning.speed;
 
     if (playbackMode == PluginParameters::BASIC)
     {
@@ -207,8 +265,12 @@ void CustomSamplerVoice::updateSpeedAndPitch(int currentNote, int pitchWheelPosi
         auto frequency = sampleSound.sampleRate / 2.f / speed;
         auto filterLimit = sampleSound.sampleRate / 2.f - 10.f;  // We've run into some issues when the filter is too close to the Nyquist frequency
 
+        // Prefer the shared pyramid, filtering in the voice only while it builds or above its top level
+        bool needsLowpass = speed > 1.f && frequency < filterLimit;
+        pyramidLevel = needsLowpass && sampleSound.pyramid.isReady() ? sampleSound.pyramid.getLevelForSpeed(speed) : -1;
+
         bool wasLowpass = doLowpass;
-        doLowpass = speed > 1.f && frequency < filterLimit;
+        doLowpass = needsLowpass && pyramidLevel < 0;
 
         if (!wasLowpass && doLowpass)
         {
@@ -216,8 +278,10 @@ void CustomSamplerVoice::updateSpeedAndPitch(int currentNote, int pitchWheelPosi
                 mainLowpass[ch]->resetProcessing(int(vc.currentPosition));
         }
 
-        if (doLowpass)
+        // Designing the filters isn't free, so only do it when the cutoff changes
+        if (doLowpass && (!wasLowpass || !juce::exactlyEqual(frequency, lowpassFrequency)))
         {
+            lowpassFrequency = frequency;
             for (int ch = 0; ch < sampleSound.sample.getNumChannels(); ch++)
             {
                 mainLowpass[ch]->setCoefficients(sampleSound.sampleRate, frequency);
@@ -228,18 +292,40 @@ void CustomSamplerVoice::updateSpeedAndPitch(int currentNote, int pitchWheelPosi
     }
     else
     {
+        // A render only holds for the tuning it was made with
+        if (frozenNote != nullptr && (!juce::exactlyEqual(tuning, frozenNote->target.pitch) || !juce::exactlyEqual(speedFactor, frozenNote->target.speed)))
+            thawStretcher();
+
         // Update the stretchers
-        mainStretcher.setPitchAndSpeed(tuning, speedFactor);
-        loopStretcher.setPitchAndSpeed(tuning, speedFactor);
-        endStretcher.setPitchAndSpeed(tuning, speedFactor);
+        for (auto* stretcher : { mainStretcher, loopStretcher, endStretcher })
+            if (stretcher)
+                stretcher->setPitchAndSpeed(tuning, speedFactor);
 
         speed = speedFactor * sampleRateConversion;
     }
 }
 
+//==============================================================================
+void CustomSamplerVoice::snapshotParams()
+{
+    params.speed = speed;
+    params.gain = juce::Decibels::decibelsToGain(float(sampleSound.gain->get()));
+    params.skipAntialiasing = sampleSound.skipAntialiasing->get();
+    params.sharedFX = sampleSound.sharedFX->get();
+    params.applyFXPre = !params.sharedFX && sampleSound.applyFXPre->get();
+    params.monoOutput = sampleSound.monoOutput->get();
+}
+
 //==============================================================================
 void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
 {
+    if (haltRequested.exchange(false, std::memory_order_acquire))
+        immediateHalt();
+
+    // The FX can keep tailing off, but the stretchers are no longer needed
+    if (vc.state == STOPPED)
+        releaseStretchers();
+
     if (vc.state == STOPPED && (!doFxTailOff || !getCurrentlyPlayingSound()))
     {
         clearCurrentNote();
@@ -251,185 +337,70 @@ void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
     {
         tempOutputBuffer.setSize(tempOutputBuffer.getNumChannels(), numSamples);
         envelopeBuffer.setSize(envelopeBuffer.getNumChannels(), numSamples);
+        fetchPositionBuffer.setSize(fetchPositionBuffer.getNumChannels(), numSamples);
+        crossfadeGainBuffer.setSize(crossfadeGainBuffer.getNumChannels(), numSamples);
+        interpolationBuffer.setSize(interpolationBuffer.getNumChannels(), numSamples);
+        segments.resize(size_t(MAX_SEGMENTS_PER_SAMPLE * numSamples + 1));
     }
     tempOutputBuffer.clear();
     envelopeBuffer.clear();
 
     if (playbackMode == PluginParameters::BUNGEE && loopStretcherBuffer.getNumSamples() < numSamples)
     {
-        mainStretcherBuffer.setSize(mainStretcherBuffer.getNumChannels(), numSamples);
         loopStretcherBuffer.setSize(loopStretcherBuffer.getNumChannels(), numSamples);
         endStretcherBuffer.setSize(endStretcherBuffer.getNumChannels(), numSamples);
     }
     
     updateSpeedAndPitch(getCurrentlyPlayingNote(), pitchWheel);
+    previousParams = params;
+    snapshotParams();
 
     bool someFXEnabled{ false };
-    for (const auto& effect : effects)
+    for (int i = 0; i < effects.size(); i++)
     {
-        someFXEnabled = someFXEnabled || effect.enablementSource->get();
+        someFXEnabled = someFXEnabled || effects[i].enablementSource->get();
     }
 
-    // Main processing loop
-    VoiceContext con;
-    for (auto ch = 0; ch < sampleSound.sample.getNumChannels(); ch++)
-    {
-        // This struct is used to easily process channel by channel 
-        con = vc;
-        for (auto i = 0; i < numSamples; i++)
-        {
-            if (con.state == STOPPED)
-            {
-                con.samplesSinceStopped++;
-                continue;
-            }
+    // Without lowpass streams (the pyramid levels are already filtered), BASIC interpolation is stateless, so the planned
+    // positions are interpolated directly with the vectorized kernel
+    const bool blockInterpolation = playbackMode == PluginParameters::BASIC && !doLowpass && !params.skipAntialiasing;
 
-            // Fetch the sample according to the playback mode
-            float sample = playbackMode == PluginParameters::BASIC ? 
-                fetchSample(ch, con.currentPosition, mainLowpass) :
-                nextSample(ch, &mainStretcher, mainStretcherBuffer, i);
+    // Looping voices read the loop crossfade from the shared splice, if it matches what they're playing
+    if (blockInterpolation && isLooping && !wavetableMode && vc.state == PLAYING && crossfade >= LoopSplice::MIN_CROSSFADE)
+        loopSplice = sampleSound.loopSplice.get(sampleStart, sampleEnd, crossfade, juce::jmax(pyramidLevel, 0));
 
-            // Crossfading
-            if (con.isCrossfadingLoop)
-            {
-                double crossfadePosition = con.currentPosition - sampleStart;
-                if (crossfadePosition >= crossfade)
-                {
-                    con.isCrossfadingLoop = false;
-                }
-                else
-                {
-                    // Power preserving crossfade (https://www.youtube.com/watch?v=-5cB3rec2T0)
-                    float crossfadeIncrease = float(std::sqrt(0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * crossfadePosition / crossfade + juce::MathConstants<float>::pi)));
-                    float crossfadeDecrease = float(std::sqrt(0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * crossfadePosition / crossfade)));
-                    float next = playbackMode == PluginParameters::BASIC ? 
-                        fetchSample(ch, con.currentPosition + sampleEnd - sampleStart - crossfade, loopLowpass) :
-                        nextSample(ch, &loopStretcher, loopStretcherBuffer, i);
-                    sample = sample * crossfadeIncrease + next * crossfadeDecrease;
-                }
-            }
+    // The state machine runs once for the whole block, splitting it into segments between transitions
+    planSegments(numSamples);
+    readPosition.store(vc.state == STOPPED ? -1. : vc.currentPosition, std::memory_order_relaxed);
 
-            if (con.isCrossfadingEnd)
-            {
-                double crossfadePosition = con.currentPosition - sampleEnd;
-                if (crossfadePosition >= crossfade)
-                {
-                    con.isCrossfadingEnd = false;
-                }
-                else
-                {
-                    float crossfadeIncrease = float(std::sqrt(0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * crossfadePosition / crossfade + juce::MathConstants<float>::pi)));
-                    float crossfadeDecrease = float(std::sqrt(0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * crossfadePosition / crossfade)));
-                    float next = playbackMode == PluginParameters::BASIC ? 
-                        fetchSample(ch, con.crossfadeEndPosition, endLowpass) :
-                        nextSample(ch, &endStretcher, endStretcherBuffer, i);
-                    sample = sample * crossfadeIncrease + next * crossfadeDecrease;
-                    con.crossfadeEndPosition += speed;
-                }
-            }
-
-            // Attack and release envelopes
-            envelopeBuffer.setSample(ch, i, 1.f);
-
-            if (con.isSmoothingAttack)
-            {
-                if (con.speedMovedSinceStart >= attackSmoothing)
-                    con.isSmoothingAttack = false;
-                else
-                    envelopeBuffer.setSample(ch, i, exponentialCurve(attackShape, con.speedMovedSinceStart / attackSmoothing));
-
-            }
-             
-            if (con.isReleasing)
-                envelopeBuffer.setSample(ch, i, envelopeBuffer.getSample(ch, i) * exponentialCurve(releaseShape, 1 - con.speedMovedSinceRelease / releaseSmoothing));
-
-            // Update the position 
-            con.currentPosition += speed;
-            con.speedMovedSinceStart += 1;
-            if (con.isReleasing)
-                con.speedMovedSinceRelease += 1;
-
-            // Handle transitions
-            if (con.state == PLAYING && isLooping && con.currentPosition >= sampleEnd - crossfade)  // Loop crossfade
-            {
-                con.currentPosition -= (sampleEnd - sampleStart + 1) - crossfade;
-                con.isCrossfadingLoop = true;
-
-                if (playbackMode == PluginParameters::BUNGEE && ch == 0)
-                {
-                    std::swap(mainStretcher, loopStretcher);
-                    mainStretcher.initialize(con.currentPosition, tuning, speedFactor);  // This could also be done at note start
-                }
-                else
-                {
-                    std::swap(mainLowpass[ch], loopLowpass[ch]);
-                    mainLowpass[ch]->resetProcessing(int(con.currentPosition));
-                }
-            }
-
-            if (midiReleased && !con.isReleasing && con.state == PLAYING)  // Midi release, end crossfade
-            {
-                if (loopingHasEnd)
-                {
-                    con.crossfadeEndPosition = con.currentPosition;
-                    con.currentPosition = sampleEnd + 1;
-                    con.state = PLAYING_END;
-                    con.isCrossfadingEnd = true;
-
-                    if (playbackMode == PluginParameters::BUNGEE && ch == 0)
-                    {
-                        std::swap(mainStretcher, endStretcher);
-                        mainStretcher.initialize(con.currentPosition, tuning, speedFactor);  // This could also be done at note start
-                    }
-                    else
-                    {
-                        std::swap(mainLowpass[ch], endLowpass[ch]);
-                        mainLowpass[ch]->resetProcessing(int(con.currentPosition));
-                    }
-                }
-                else
-                {
-                    con.isReleasing = true;
-                }
-            }
-
-            if (((con.state == PLAYING && !isLooping) || con.state == PLAYING_END) && !con.isReleasing &&
-                con.currentPosition > effectiveEnd - releaseSmoothing * speed)  // Release smoothing
-            {
-                con.isReleasing = true;
-            }
-
-            if (con.currentPosition > effectiveEnd || (con.isReleasing && con.speedMovedSinceRelease >= releaseSmoothing))  // End of playback reached
-                con.state = STOPPED;
+    if (blockInterpolation)
+        interpolateBlockFetches(numSamples);
+    else
+        renderSegments(numSamples);
 
-            // Scale with standard velocity curve
-            sample *= juce::Decibels::decibelsToGain(40 * log10(noteVelocity));
-            sample *= juce::Decibels::decibelsToGain(float(sampleSound.gain->get()));
-
-            tempOutputBuffer.setSample(ch, i, sample);
-        }
-    }
-    vc = con;
+    loopSplice = nullptr;
 
     // Check for updated FX order
     if (updateFXParamsTimer == UPDATE_PARAMS_LENGTH)
-        initializeFx();
+        effects.updateOrder(sampleSound);
 
     // Apply envelope here or after FX if PRE_FX is enabled
-    if (!sampleSound.applyFXPre->get())
+    if (!params.applyFXPre)
         for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
-            juce::FloatVectorOperations::multiply(tempOutputBuffer.getWritePointer(ch), tempOutputBuffer.getReadPointer(ch), envelopeBuffer.getReadPointer(ch), numSamples);
+            juce::FloatVectorOperations::multiply(tempOutputBuffer.getWritePointer(ch), tempOutputBuffer.getReadPointer(ch), envelopeBuffer.getReadPointer(0), numSamples);
 
     // Apply FX
     int reverbSampleDelay = int(1000.f + sampleSound.reverbPredelay->get() * float(getSampleRate()) / 1000.f);  // the 1000.f is approximate
     someFXEnabled = false;
-    for (auto& effect : effects)
+    for (int i = 0; i < effects.size(); i++)
     {
-        // Check for updated enablement
-        bool enablement = effect.enablementSource->get();
+        auto& effect = effects[i];
+
+        // Check for updated enablement, with shared FX the FxBus processes the effects instead
+        bool enablement = !params.sharedFX && effect.isAvailable();
         if (!effect.enabled && enablement)
         {
-            effect.fx->initialize(sampleSound.sample.getNumChannels(), int(getSampleRate()));
+            effect.fx->reset();
             effect.fx->updateParams(sampleSound, false);
         }
         effect.enabled = enablement;
@@ -443,7 +414,7 @@ void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
             effect.fx->process(tempOutputBuffer, numSamples);
 
             // Check if an effect should be locally disabled. Note that reverb can only be disabled after a certain delay
-            if (con.state == STOPPED && numSamples > 10 && !(effect.fxType == PluginParameters::REVERB && con.samplesSinceStopped <= reverbSampleDelay)) 
+            if (vc.state == STOPPED && numSamples > 10 && !(effect.fxType == PluginParameters::REVERB && vc.samplesSinceStopped <= reverbSampleDelay)) 
             {
                 bool disable{ true };
                 for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
@@ -461,17 +432,17 @@ void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
         }
     }
 
-    if (sampleSound.applyFXPre->get())
+    if (params.applyFXPre)
         for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
-            juce::FloatVectorOperations::multiply(tempOutputBuffer.getWritePointer(ch), tempOutputBuffer.getReadPointer(ch), envelopeBuffer.getReadPointer(ch), numSamples);
+            juce::FloatVectorOperations::multiply(tempOutputBuffer.getWritePointer(ch), tempOutputBuffer.getReadPointer(ch), envelopeBuffer.getReadPointer(0), numSamples);
 
     updateFXParamsTimer--;
     if (updateFXParamsTimer <= 0)
         updateFXParamsTimer = UPDATE_PARAMS_LENGTH;
-    doFxTailOff = !sampleSound.applyFXPre->get() && someFXEnabled && !effects.empty();
+    doFxTailOff = !params.applyFXPre && someFXEnabled;
 
     // Check RMS level to see if a voice should be ended despite tailing off effects
-    if (con.state == STOPPED && someFXEnabled && numSamples > 10 && con.samplesSinceStopped > reverbSampleDelay)
+    if (vc.state == STOPPED && someFXEnabled && numSamples > 10 && vc.samplesSinceStopped > reverbSampleDelay)
     {
         bool end{ true };  // Whether all channels are below the threshold
         for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
@@ -490,7 +461,21 @@ void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
         }
     }
 
-    mixToBuffer(tempOutputBuffer, outputBuffer, startSample, numSamples, sampleSound.monoOutput->get());
+    // A voice that's being removed ramps down, and halts once it's silent
+    const bool fadingOut = isFadingOut();
+    if (fadingOut)
+    {
+        const int fadeSamples = juce::jmin(numSamples, fadeOutRemaining);
+        const float startGain = float(fadeOutRemaining) / float(fadeOutLength);
+        fadeOutRemaining -= fadeSamples;
+        for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
+        {
+            tempOutputBuffer.applyGainRamp(ch, 0, fadeSamples, startGain, float(fadeOutRemaining) / float(fadeOutLength));
+            tempOutputBuffer.clear(ch, fadeSamples, numSamples - fadeSamples);
+        }
+    }
+
+    mixToBuffer(tempOutputBuffer, outputBuffer, startSample, numSamples, params.monoOutput);
 
     // Add the previous tail-off samples to the output buffer
     tailOffBuffer.setSize(tempOutputBuffer.getNumChannels(), tailOffBuffer.getNumSamples(), true, true);
@@ -509,6 +494,177 @@ void CustomSamplerVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
         i++;
     }
 
+    if (fadingOut && !isFadingOut())
+        immediateHalt();
+}
+
+void CustomSamplerVoice::planSegments(int numSamples)
+{
+    resetBlockFetches(numSamples);
+    float* envelope = envelopeBuffer.getWritePointer(0);
+
+    numSegments = 1;
+    segments[0] = VoiceSegment();
+    bool segmentHasFlags{ false };
+
+    // The speed is ramped from the previous block, reaching the new speed on the last sample
+    const float speedStep = (params.speed - previousParams.speed) / float(numSamples);
+
+    // Splice positions are in the coordinates of the pyramid level
+    const double spliceScale = pyramidLevel > 0 ? 1. / sampleSound.pyramid.getLevel(pyramidLevel).decimation : 1.;
+
+    // The envelopes advance by one sample of time each step
+    if (vc.isSmoothingAttack)
+        attackRamp.reset(attackShape, vc.speedMovedSinceStart / attackSmoothing, 1.f / attackSmoothing);
+    if (vc.isReleasing)
+        releaseRamp.reset(releaseShape, 1 - vc.speedMovedSinceRelease / releaseSmoothing, -1.f / releaseSmoothing);
+
+    for (auto i = 0; i < numSamples; i++)
+    {
+        const float stepSpeed = previousParams.speed + speedStep * float(i + 1);
+
+        // The flags of this sample, which decide whether the current segment can be extended
+        bool stopped{ vc.state == STOPPED };
+        bool crossfadingLoop{ false }, crossfadingEnd{ false };
+
+        if (stopped)
+        {
+            vc.samplesSinceStopped++;
+        }
+        else
+        {
+            fetchPositionBuffer.setSample(MAIN_FETCH, i, vc.currentPosition);
+
+            // Crossfading
+            if (vc.isCrossfadingLoop)
+            {
+                double crossfadePosition = vc.currentPosition - sampleStart;
+                if (crossfadePosition >= crossfade)
+                {
+                    vc.isCrossfadingLoop = false;
+                }
+                else if (loopSplice)
+                {
+                    // The splice already mixes both sides of the crossfade, so it replaces the main fetch
+                    fetchPositionBuffer.setSample(MAIN_FETCH, i, -1.);
+                    recordBlockFetch(LOOP_FETCH, i, vc.currentPosition * spliceScale - loopSplice->first, 1.f, 1.f);
+                    crossfadingLoop = true;
+                }
+                else
+                {
+                    // Power preserving crossfade (https://www.youtube.com/watch?v=-5cB3rec2T0)
+                    float crossfadeIncrease, crossfadeDecrease;
+                    crossfadeTable.getGains(crossfadePosition * crossfadeToIndex, crossfadeIncrease, crossfadeDecrease);
+                    recordBlockFetch(LOOP_FETCH, i, vc.currentPosition + sampleEnd - sampleStart - crossfade, crossfadeIncrease, crossfadeDecrease);
+                    crossfadingLoop = true;
+                }
+            }
+
+            if (vc.isCrossfadingEnd)
+            {
+                double crossfadePosition = vc.currentPosition - sampleEnd;
+                if (crossfadePosition >= crossfade)
+                {
+                    vc.isCrossfadingEnd = false;
+                }
+                else
+                {
+                    float crossfadeIncrease, crossfadeDecrease;
+                    crossfadeTable.getGains(crossfadePosition * crossfadeToIndex, crossfadeIncrease, crossfadeDecrease);
+                    recordBlockFetch(END_FETCH, i, vc.crossfadeEndPosition, crossfadeIncrease, crossfadeDecrease);
+                    crossfadingEnd = true;
+                    vc.crossfadeEndPosition += stepSpeed;
+                }
+            }
+        }
+
+        // Extend the current segment or start a new one
+        auto* segment = &segments[size_t(numSegments - 1)];
+        if (segmentHasFlags && (segment->stopped != stopped || segment->crossfadingLoop != crossfadingLoop || segment->crossfadingEnd != crossfadingEnd))
+            segment = &startSegment(i, NO_EVENT, 0.);
+        if (segment->start == i)
+        {
+            segment->stopped = stopped;
+            segment->crossfadingLoop = crossfadingLoop;
+            segment->crossfadingEnd = crossfadingEnd;
+            segmentHasFlags = true;
+        }
+
+        if (stopped)
+            continue;
+
+        // Attack and release envelopes
+        envelope[i] = 1.f;
+
+        if (vc.isSmoothingAttack)
+        {
+            if (vc.speedMovedSinceStart >= attackSmoothing)
+                vc.isSmoothingAttack = false;
+            else
+                envelope[i] = attackRamp.next();
+        }
+
+        if (vc.isReleasing)
+            envelope[i] = envelope[i] * releaseRamp.next();
+
+        // Update the position 
+        vc.currentPosition += stepSpeed;
+        vc.speedMovedSinceStart += 1;
+        if (vc.isReleasing)
+            vc.speedMovedSinceRelease += 1;
+
+        // Handle transitions, which start a new segment from the next sample
+        if (vc.state == PLAYING && isLooping && vc.currentPosition >= float(sampleEnd) - crossfade)  // Loop crossfade
+        {
+            vc.currentPosition -= float(sampleEnd - sampleStart + 1) - crossfade;
+            vc.isCrossfadingLoop = true;
+            startSegment(i + 1, LOOP_WRAP, vc.currentPosition);
+            segmentHasFlags = false;
+        }
+
+        if (midiReleased && !vc.isReleasing && vc.state == PLAYING)  // Midi release, end crossfade
+        {
+            if (loopingHasEnd)
+            {
+                vc.crossfadeEndPosition = vc.currentPosition;
+                vc.currentPosition = sampleEnd + 1;
+                vc.state = PLAYING_END;
+                vc.isCrossfadingEnd = true;
+                startSegment(i + 1, END_START, vc.currentPosition);
+                segmentHasFlags = false;
+            }
+            else
+            {
+                vc.isReleasing = true;
+                releaseRamp.reset(releaseShape, 1 - vc.speedMovedSinceRelease / releaseSmoothing, -1.f / releaseSmoothing);
+            }
+        }
+
+        if (((vc.state == PLAYING && !isLooping) || vc.state == PLAYING_END) && !vc.isReleasing &&
+            vc.currentPosition > float(effectiveEnd) - releaseSmoothing * stepSpeed)  // Release smoothing
+        {
+            vc.isReleasing = true;
+            releaseRamp.reset(releaseShape, 1 - vc.speedMovedSinceRelease / releaseSmoothing, -1.f / releaseSmoothing);
+        }
+
+        if (vc.currentPosition > effectiveEnd || (vc.isReleasing && vc.speedMovedSinceRelease >= releaseSmoothing))  // End of playback reached
+            vc.state = STOPPED;
+    }
+
+    segments[size_t(numSegments - 1)].end = numSamples;
+}
+
+CustomSamplerVoice::VoiceSegment& CustomSamplerVoice::startSegment(int start, SegmentEvent event, double eventPosition)
+{
+    segments[size_t(numSegments - 1)].end = start;
+
+    auto& segment = segments[size_t(numSegments++)];
+    segment = VoiceSegment();
+    segment.start = start;
+    segment.end = start;
+    segment.event = event;
+    segment.eventPosition = eventPosition;
+    return segment;
 }
 
 float CustomSamplerVoice::fetchSample(int channel, double position, std::vector<std::unique_ptr<LowpassStream>>& lowpassStreams) const
@@ -516,7 +672,7 @@ float CustomSamplerVoice::fetchSample(int channel, double position, std::vector<
     if (0 > position || position >= float(sampleSound.sample.getNumSamples()))
         return 0.f;
 
-    if (sampleSound.skipAntialiasing->get())
+    if (params.skipAntialiasing)
     {
         return sampleSound.sample.getSample(channel, int(position));
     }
@@ -526,65 +682,254 @@ float CustomSamplerVoice::fetchSample(int channel, double position, std::vector<
     }
 }
 
-float CustomSamplerVoice::nextSample(int channel, BungeeStretcher* stretcher, juce::AudioBuffer<float>& channelBuffer, int i) const
+void CustomSamplerVoice::resetBlockFetches(int numSamples)
 {
-    if (channel == 0)
+    for (int fetch = 0; fetch < NUM_BLOCK_FETCHES; fetch++)
     {
-        for (int ch = 1; ch < sampleSound.sample.getNumChannels(); ch++)
-            channelBuffer.setSample(ch - 1, i, stretcher->nextSample(ch, false));
-        return stretcher->nextSample(0);
+        juce::FloatVectorOperations::fill(fetchPositionBuffer.getWritePointer(fetch), -1., numSamples);  // Fetches before 0 are silent
+        juce::FloatVectorOperations::fill(crossfadeGainBuffer.getWritePointer(2 * fetch), 1.f, numSamples);
+        juce::FloatVectorOperations::fill(crossfadeGainBuffer.getWritePointer(2 * fetch + 1), 0.f, numSamples);
+        blockFetchUsed[size_t(fetch)] = fetch == MAIN_FETCH;
     }
+}
+
+void CustomSamplerVoice::recordBlockFetch(BlockFetch fetch, int i, double position, float currentGain, float fetchGain)
+{
+    fetchPositionBuffer.setSample(fetch, i, position);
+    crossfadeGainBuffer.setSample(2 * fetch, i, currentGain);
+    crossfadeGainBuffer.setSample(2 * fetch + 1, i, fetchGain);
+    blockFetchUsed[fetch] = true;
+}
+
+void CustomSamplerVoice::interpolateBlockFetches(int numSamples)
+{
+    const bool usePyramid = pyramidLevel > 0;
+
+    // Pyramid levels can be decimated, so the positions are scaled to match
+    if (usePyramid && sampleSound.pyramid.getLevel(pyramidLevel).decimation > 1)
+    {
+        double scale = 1. / sampleSound.pyramid.getLevel(pyramidLevel).decimation;
+        for (int fetch = 0; fetch < NUM_BLOCK_FETCHES; fetch++)
+            if (blockFetchUsed[size_t(fetch)] && !(fetch == LOOP_FETCH && loopSplice))
+                juce::FloatVectorOperations::multiply(fetchPositionBuffer.getWritePointer(fetch), scale, numSamples);
+    }
+
+    // The pyramid levels and the sample can be stored differently (see SamplePyramid::LevelBuffer)
+    auto interpolate = [this, numSamples](const auto& source)
+    {
+        for (int ch = 0; ch < tempOutputBuffer.getNumChannels(); ch++)
+        {
+            float* output = tempOutputBuffer.getWritePointer(ch);
+            Lanczos::interpolateChannel(source, ch, fetchPositionBuffer.getReadPointer(MAIN_FETCH), output, numSamples);
+
+            // Crossfades are applied in the same order as the per-sample path. Outside a crossfade the gains are (1, 0), which leaves the sample unchanged.
+            float* next = interpolationBuffer.getWritePointer(0);
+            for (auto fetch : { LOOP_FETCH, END_FETCH })
+            {
+                if (!blockFetchUsed[fetch])
+                    continue;
+
+                if (fetch == LOOP_FETCH && loopSplice)
+                    Lanczos::interpolateChannel(loopSplice->data, ch, fetchPositionBuffer.getReadPointer(fetch), next, numSamples);
+                else
+                    Lanczos::interpolateChannel(source, ch, fetchPositionBuffer.getReadPointer(fetch), next, numSamples);
+                juce::FloatVectorOperations::multiply(output, crossfadeGainBuffer.getReadPointer(2 * fetch), numSamples);
+                juce::FloatVectorOperations::multiply(next, crossfadeGainBuffer.getReadPointer(2 * fetch + 1), numSamples);
+                juce::FloatVectorOperations::add(output, next, numSamples);
+            }
+
+            applyVelocityAndGain(ch, numSamples);
+        }
+    };
+
+    if (usePyramid)
+        interpolate(sampleSound.pyramid.getLevel(pyramidLevel).data);
     else
+        interpolate(sampleSound.sample);
+}
+
+void CustomSamplerVoice::renderSegments(int numSamples)
+{
+    if (playbackMode == PluginParameters::BUNGEE)
     {
-        return channelBuffer.getSample(channel - 1, i);
+        renderStretchedSegments();
+        prerollStretchers();
+        for (int ch = 0; ch < sampleSound.sample.getNumChannels(); ch++)
+            applyVelocityAndGain(ch, numSamples);
+        return;
+    }
+
+    const double* positions[NUM_BLOCK_FETCHES]{};
+    const float* currentGains[NUM_BLOCK_FETCHES]{};
+    const float* fetchGains[NUM_BLOCK_FETCHES]{};
+    for (int fetch = 0; fetch < NUM_BLOCK_FETCHES; fetch++)
+    {
+        positions[fetch] = fetchPositionBuffer.getReadPointer(fetch);
+        currentGains[fetch] = crossfadeGainBuffer.getReadPointer(2 * fetch);
+        fetchGains[fetch] = crossfadeGainBuffer.getReadPointer(2 * fetch + 1);
+    }
+
+    for (int ch = 0; ch < sampleSound.sample.getNumChannels(); ch++)
+    {
+        float* output = tempOutputBuffer.getWritePointer(ch);
+        for (int s = 0; s < numSegments; s++)
+        {
+            const auto& segment = segments[size_t(s)];
+            if (segment.event != NO_EVENT)
+                applySegmentEvent(ch, segment);
+            if (segment.stopped)
+                continue;
+
+            for (int i = segment.start; i < segment.end; i++)
+                output[i] = fetchSample(ch, positions[MAIN_FETCH][i], mainLowpass);
+
+            if (segment.crossfadingLoop)
+                for (int i = segment.start; i < segment.end; i++)
+                    output[i] = output[i] * currentGains[LOOP_FETCH][i] + fetchSample(ch, positions[LOOP_FETCH][i], loopLowpass) * fetchGains[LOOP_FETCH][i];
+
+            if (segment.crossfadingEnd)
+                for (int i = segment.start; i < segment.end; i++)
+                    output[i] = output[i] * currentGains[END_FETCH][i] + fetchSample(ch, positions[END_FETCH][i], endLowpass) * fetchGains[END_FETCH][i];
+        }
+
+        applyVelocityAndGain(ch, numSamples);
     }
 }
 
-float CustomSamplerVoice::getEnvelopeGain() const
+void CustomSamplerVoice::renderStretchedSegments()
 {
-    float gain = 1.f;
-    if (vc.isSmoothingAttack)
-        gain *= exponentialCurve(attackShape, vc.speedMovedSinceStart / attackSmoothing);
-    if (vc.isReleasing)
-        gain *= exponentialCurve(releaseShape, 1 - vc.speedMovedSinceRelease / releaseSmoothing);
-    return gain;
+    for (int s = 0; s < numSegments; s++)
+    {
+        const auto& segment = segments[size_t(s)];
+        if (segment.event != NO_EVENT)
+            applySegmentEvent(0, segment);
+        if (segment.stopped)
+            continue;
+
+        nextStretchedBlock(*mainStretcher, tempOutputBuffer.getArrayOfWritePointers(), segment.start, segment.end - segment.start);
+
+        if (segment.crossfadingLoop)
+            crossfadeStretcher(*loopStretcher, loopStretcherBuffer, LOOP_FETCH, segment);
+
+        if (segment.crossfadingEnd)
+            crossfadeStretcher(*endStretcher, endStretcherBuffer, END_FETCH, segment);
+    }
 }
 
-//==============================================================================
-void CustomSamplerVoice::initializeFx()
+void CustomSamplerVoice::prerollStretchers()
 {
-    auto fxOrder = sampleSound.getFxOrder();
-    bool changed = false;
-    for (size_t i = 0; i < fxOrder.size(); i++)
+    if (vc.state != PLAYING)
+        return;
+
+    // After a wrap, the loop stretcher plays out the loop crossfade first. A wrap starts between sampleStart - 1 and one step later.
+    if (isLooping && !vc.isCrossfadingLoop)
     {
-        if (effects.size() <= i || effects[i].fxType != fxOrder[i])
+        if (!loopPrerollStarted)
         {
-            changed = true;
-            break;
+            // The render has played out its crossfade, so it's no longer needed
+            if (loopStretcher == frozenStretcher)
+            {
+                frozenStretcher = nullptr;
+                frozenNote = nullptr;
+            }
+            loopStretcher->beginPreroll(sampleStart - 1., tuning, speedFactor);
         }
+        loopPrerollStarted = true;
+        loopStretcher->continuePreroll(PREROLL_GRAINS_PER_BLOCK);
+    }
+
+    // The end always starts right after sampleEnd
+    if (loopingHasEnd)
+    {
+        if (!endPrerollStarted)
+            endStretcher->beginPreroll(sampleEnd + 1., tuning, speedFactor);
+        endPrerollStarted = true;
+        endStretcher->continuePreroll(PREROLL_GRAINS_PER_BLOCK);
     }
-    if (changed)
+}
+
+void CustomSamplerVoice::nextStretchedBlock(BungeeStretcher& stretcher, float* const* out, int startSample, int numSamples)
+{
+    if (&stretcher == frozenStretcher)
     {
-        effects.clear();
-        for (auto& fxType : fxOrder)
+        if (frozenIndex + numSamples <= frozenNote->render.getNumSamples())
         {
-            switch (fxType)
-            {
-            case PluginParameters::DISTORTION:
-                effects.emplace_back(PluginParameters::DISTORTION, std::make_unique<Distortion>(), sampleSound.distortionEnabled);
-                break;
-            case PluginParameters::REVERB:
-                effects.emplace_back(PluginParameters::REVERB, std::make_unique<Reverb>(), sampleSound.reverbEnabled);
-                break;
-            case PluginParameters::CHORUS:
-                effects.emplace_back(PluginParameters::CHORUS, std::make_unique<Chorus>(expectedBlockSize), sampleSound.chorusEnabled);
-                break;
-            case PluginParameters::EQ:
-                effects.emplace_back(PluginParameters::EQ, std::make_unique<BandEQ>(), sampleSound.eqEnabled);
-                break;
-            }
+            for (int ch = 0; ch < frozenNote->render.getNumChannels(); ch++)
+                juce::FloatVectorOperations::copy(out[ch] + startSample, frozenNote->render.getReadPointer(ch, frozenIndex), numSamples);
+            frozenIndex += numSamples;
+            return;
         }
+
+        thawStretcher();  // Past the end of the render
     }
+
+    stretcher.nextBlock(out, startSample, numSamples);
+}
+
+void CustomSamplerVoice::thawStretcher()
+{
+    if (frozenStretcher)
+        frozenStretcher->initialize(frozenNote->target.position + double(frozenIndex) * frozenStep, tuning, speedFactor);
+
+    frozenStretcher = nullptr;
+    frozenNote = nullptr;
+}
+
+void CustomSamplerVoice::crossfadeStretcher(BungeeStretcher& stretcher, juce::AudioBuffer<float>& stretcherBuffer, BlockFetch fetch, const VoiceSegment& segment)
+{
+    nextStretchedBlock(stretcher, stretcherBuffer.getArrayOfWritePointers(), segment.start, segment.end - segment.start);
+
+    const float* currentGains = crossfadeGainBuffer.getReadPointer(2 * fetch);
+    const float* fetchGains = crossfadeGainBuffer.getReadPointer(2 * fetch + 1);
+    for (int ch = 0; ch < sampleSound.sample.getNumChannels(); ch++)
+    {
+        float* output = tempOutputBuffer.getWritePointer(ch);
+        const float* next = stretcherBuffer.getReadPointer(ch);
+        for (int i = segment.start; i < segment.end; i++)
+            output[i] = output[i] * currentGains[i] + next[i] * fetchGains[i];
+    }
+}
+
+void CustomSamplerVoice::applySegmentEvent(int channel, const VoiceSegment& segment)
+{
+    if (playbackMode == PluginParameters::BUNGEE)
+    {
+        // The stretchers hold every channel, so this is only called once (for channel 0)
+        std::swap(mainStretcher, segment.event == LOOP_WRAP ? loopStretcher : endStretcher);
+        mainStretcher->initialize(segment.eventPosition, tuning, speedFactor);  // Cheap if prerollStretchers() got there first
+
+        // The previous main stretcher now plays out the crossfade, and needs to be prerolled again afterwards
+        if (segment.event == LOOP_WRAP)
+            loopPrerollStarted = false;
+    }
+    else
+    {
+        std::swap(mainLowpass[size_t(channel)], segment.event == LOOP_WRAP ? loopLowpass[size_t(channel)] : endLowpass[size_t(channel)]);
+        mainLowpass[size_t(channel)]->resetProcessing(int(segment.eventPosition));
+    }
+}
+
+void CustomSamplerVoice::applyVelocityAndGain(int channel, int numSamples)
+{
+    // The sample gain is ramped from the previous block
+    const float gainStep = (params.gain - previousParams.gain) / float(numSamples);
+
+    float* output = tempOutputBuffer.getWritePointer(channel);
+    for (int i = 0; i < numSamples; i++)
+    {
+        output[i] = float(output[i] * velocityGain);
+        output[i] *= previousParams.gain + gainStep * float(i + 1);
+    }
+}
+
+float CustomSamplerVoice::getEnvelopeGain() const
+{
+    float gain = 1.f;
+    if (vc.isSmoothingAttack)
+        gain *= exponentialCurve(attackShape, vc.speedMovedSinceStart / attackSmoothing);
+    if (vc.isReleasing)
+        gain *= exponentialCurve(releaseShape, 1 - vc.speedMovedSinceRelease / releaseSmoothing);
+    return gain;
 }
 
 //==============================================================================
@@ -604,6 +949,9 @@ float CustomSamplerVoice::lanczosInterpolate(int channel, double position, std::
     // Then, interpolate
     int floorIndex = int(std::floor(position));
 
+    float weights[Lanczos::NUM_TAPS];
+    Lanczos::computeWeights(float(position - floorIndex), weights);
+
     float result = 0.f;
     for (int i = -LANCZOS_WINDOW_SIZE + 1; i <= LANCZOS_WINDOW_SIZE; i++)
     {
@@ -623,13 +971,7 @@ float CustomSamplerVoice::lanczosInterpolate(int channel, double position, std::
             }
         }
 
-        float window = lanczosWindow(position - floorIndex - i);
-        result += sample * window;
+        result += sample * weights[i + LANCZOS_WINDOW_SIZE - 1];
     }
     return result;
-}
-
-float CustomSamplerVoice::lanczosWindow(double x)
-{
-    return x == 0.f ? 1.f : float(LANCZOS_WINDOW_SIZE * std::sin(juce::MathConstants<float>::pi * x) * std::sin(juce::MathConstants<float>::pi * x / LANCZOS_WINDOW_SIZE) * INVERSE_SIN_SQUARED / (x * x));
 }
\ No newline at end of file
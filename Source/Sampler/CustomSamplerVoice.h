@@ -12,8 +12,10 @@
 #include <JuceHeader.h>
 
 #include "SamplerParameters.h"
-#include "Effects/Effect.h"
-#include "Stretcher.h"
+#include "Effects/EffectRack.h"
+#include "FreezeCache.h"
+#include "LanczosKernel.h"
+#include "StretcherPool.h"
 #include <libMTSClient.h>
 
 /** This enum includes the different states a voice can be in */
@@ -24,8 +26,8 @@ enum VoiceState
     STOPPED
 };
 
-/** The context information for sample by sample processing is stored in its own struct. This
-    is primarily to allow for easy multichannel processing but also encapsulates the state nicely.
+/** The context information for sample by sample processing is stored in its own struct. It is advanced
+    once per block by the segment planner, for all channels, and encapsulates the state nicely.
     Note that the smoothing variables are an important part of the state transition logic.
 */
 struct VoiceContext 
@@ -44,8 +46,65 @@ struct VoiceContext
     int samplesSinceStopped{ 0 };  // This is needed to time the RMS measurements for reverb tail off (since it has a delay)
 };
 
+/** The parameters read by the render loops are copied here once per block, so the hot loops don't touch any atomics.
+    Gain and speed are ramped per sample from the previous block's snapshot, which keeps automation free of zipper noise.
+*/
+struct VoiceParamSnapshot
+{
+    float gain{ 1.f };  // The sample gain, not including velocity
+    float speed{ 0.f };  // BASIC mode playback speed
+    bool skipAntialiasing{ false };
+    bool applyFXPre{ false };  // Never set with sharedFX, where the envelope always comes before the (shared) FX
+    bool sharedFX{ false };  // The voice has no FX of its own, they're applied to the mix by the FxBus
+    bool monoOutput{ false };
+};
+
+/** Generates CustomSamplerVoice::exponentialCurve(shape, x) for an x that moves by a constant step each sample. Instead of
+    two exponentials per sample, e^(shape * x) is advanced with a single multiply. The recurrence runs in double precision
+    and is restarted every block, so it doesn't drift from the exact curve.
+*/
+class EnvelopeRamp
+{
+public:
+    void reset(float shape, float x, float step)
+    {
+        linear = juce::approximatelyEqual(shape, 0.f, juce::Tolerance<float>().withAbsolute(0.001f));
+        if (linear)
+        {
+            value = x;
+            increment = step;
+        }
+        else
+        {
+            value = std::exp(double(shape) * x);
+            increment = std::exp(double(shape) * step);
+            scale = 1. / (std::exp(double(shape)) - 1.);
+        }
+    }
+
+    /** Returns the curve at the current x, then advances it */
+    float next()
+    {
+        if (linear)
+        {
+            float result = float(value);
+            value += increment;
+            return result;
+        }
+
+        float result = float((value - 1.) * scale);
+        value *= increment;
+        return result;
+    }
+
+private:
+    bool linear{ true };
+    double value{ 0. }, increment{ 0. }, scale{ 1. };
+};
+
 /** This class is used to store the state of the lowpass filter for a channel / stream
     Because of our use case, a circular buffer is used to store past samples, large enough for the size of the lanczos window.
+    Voices only filter this way while the SamplePyramid is still building, or when playing faster than its top level.
  */
 class LowpassStream
 {
@@ -94,14 +153,14 @@ public:
 
     int getNextSample() const { return nextSample; }
 
-    /** Following juce::dsp::FilterDesign::designIIRLowpassHighOrderButterworthMethod(), this is theoretically -48db above 20khz */
+    /** See makeLowpassStages() */
     void setCoefficients(int sampleRate, float frequency)
     {
-        float order = 8.f;
-        filter1.setCoefficients(juce::IIRCoefficients::makeLowPass(sampleRate, frequency, 1.f / (2.f * std::cos(1.f * juce::MathConstants<float>::pi / (order * 2.f)))));
-        filter2.setCoefficients(juce::IIRCoefficients::makeLowPass(sampleRate, frequency, 1.f / (2.f * std::cos(3.f * juce::MathConstants<float>::pi / (order * 2.f)))));
-        filter3.setCoefficients(juce::IIRCoefficients::makeLowPass(sampleRate, frequency, 1.f / (2.f * std::cos(5.f * juce::MathConstants<float>::pi / (order * 2.f)))));
-        filter4.setCoefficients(juce::IIRCoefficients::makeLowPass(sampleRate, frequency, 1.f / (2.f * std::cos(7.f * juce::MathConstants<float>::pi / (order * 2.f)))));
+        const auto stages = makeLowpassStages(sampleRate, frequency);
+        filter1.setCoefficients(stages[0]);
+        filter2.setCoefficients(stages[1]);
+        filter3.setCoefficients(stages[2]);
+        filter4.setCoefficients(stages[3]);
     }
 
     int getStartSample() const { return startSample; }
@@ -118,19 +177,6 @@ private:
     int nextSample{ 0 };  // The next sample to be processed
 };
 
-/** This struct serves to separate per instance enablement of effects from the effect classes themselves */
-struct Fx
-{
-    Fx(PluginParameters::FxTypes fxType, std::unique_ptr<Effect> fx, juce::AudioParameterBool* enablementSource) :
-        fxType(fxType), fx(std::move(fx)), enablementSource(enablementSource) {}
-
-    PluginParameters::FxTypes fxType;
-    std::unique_ptr<Effect> fx;
-    juce::AudioParameterBool* enablementSource;
-    bool enabled{ false };
-    bool locallyDisabled{ false };  // used to avoid empty processing
-};
-
 //==============================================================================
 /** The CustomSamplerVoice is the main DSP logic of this plugin. It can pitch shift directly or integrate with a 3rd party
     algorithm. It supports antialiasing, an FX chain, different looping modes, attack and release, and smooth crossfading. 
@@ -138,16 +184,25 @@ struct Fx
 class CustomSamplerVoice final : public juce::SynthesiserVoice
 {
 public:
-    CustomSamplerVoice(const SamplerParameters& samplerSound, MTSClient* client, double applicationSampleRate, int expectedBlockSize, bool initSample = true);
+    CustomSamplerVoice(const SamplerParameters& samplerSound, StretcherPool& stretcherPool, FreezeCache& freezeCache, MTSClient* client, double applicationSampleRate, int expectedBlockSize, bool initSample = true);
+    ~CustomSamplerVoice() override;
 
     /** For general convenience, we'd like to be able to initialize all voices at plugin start */
     void initializeSample();
 
+    /** Allocates the buffers of the enabled effects, unless they're shared. This isn't real-time safe, so it's called from the
+        message thread, but it's fine to call while the voice is playing.
+    */
+    void allocateEffects();
+
     /** Updates the speed and pitch, setting stretchers and filter cutoffs correctly.
         Before calling this the first time, set doLowpass = false so that it resets the lowpass filters.
      */
     void updateSpeedAndPitch(int currentNote, int pitchWheelPosition);
 
+    /** Copies the current parameters into params, call this once per block after updateSpeedAndPitch() */
+    void snapshotParams();
+
     //==============================================================================
     /** Returns whether the voice is actively playing (not stopped or tailing off) */
     bool isPlaying() const { return getCurrentlyPlayingSound() && vc.state != STOPPED; }
@@ -161,6 +216,9 @@ public:
     /** Get the effective location of the sampler voice relative to the original sample, not precise in ADVANCED mode */
     double getPosition() const { return vc.currentPosition; }
 
+    /** The voice's position as of its last block, or -1 if it's stopped. Unlike getPosition(), this can be read from any thread. */
+    double getReadPosition() const { return readPosition.load(std::memory_order_relaxed); }
+
     /** Get the current gain of the voice in the attack and release envelopes, for visualization */
     float getEnvelopeGain() const;
 
@@ -168,9 +226,35 @@ public:
     static const float exponentialCurve(float a, float x) { return juce::approximatelyEqual(a, 0.f, juce::Tolerance<float>().withAbsolute(0.001f)) ? x : (std::exp(a * x) - 1) / (std::exp(a) - 1); }
 
     void stopNote(float velocity, bool allowTailOff) override;
+
+    /** Stops the voice right away, this must only be called from the thread that renders it */
     void immediateHalt();
 
+    /** Asks the voice to halt at the start of its next block, this can be called from any thread. A note started after the
+        request isn't halted.
+    */
+    void requestHalt() { haltRequested.store(true, std::memory_order_release); }
+
+    static constexpr double FADE_OUT_MS{ 10. };
+
+    /** Ramps the voice down to silence over FADE_OUT_MS as it keeps rendering, then halts it, for voices that are removed from
+        the synth while they're playing. A voice that isn't playing is halted right away.
+    */
+    void fadeOut();
+    bool isFadingOut() const { return fadeOutRemaining > 0; }
+
+    /** Renders the rest of a fadeOut() into the output, for a voice that the synth no longer renders */
+    void renderFadeOut(juce::AudioBuffer<float>& outputBuffer, int numSamples);
+
 private:
+    /** Checks out the stretchers a BUNGEE note needs from the pool, returns false (holding none) if there aren't enough. The main
+        stretcher is preferably one that the pool already prerolled to the note's start.
+    */
+    bool checkoutStretchers(const StretcherPool::WarmTarget& noteStart);
+
+    /** Returns the stretchers to the pool, once the voice has stopped */
+    void releaseStretchers();
+
     bool canPlaySound(juce::SynthesiserSound*) override { return true; }
     void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition) override;
     void pitchWheelMoved(int newPitchWheelValue) override;
@@ -184,25 +268,92 @@ private:
     */
     float fetchSample(int channel, double position, std::vector<std::unique_ptr<LowpassStream>>& lowpassStreams) const;
 
-    /** Fetches the next sample from a stretcher, in ADVANCED mode. Note that on channel 0, the stretcher
-        advances and stores the other channels' output in the channel buffer at index i. Then it's fetched
-        from there when nextSample is called with the later channel.
-     */
-    float nextSample(int channel, BungeeStretcher* stretcher, juce::AudioBuffer<float>& channelBuffer, int i) const;
+    /** The fetches a voice can make per output sample. Their positions and crossfade gains are recorded by the segment planner,
+        then the block is either interpolated with Lanczos::interpolateBlock or rendered segment by segment.
+    */
+    enum BlockFetch
+    {
+        MAIN_FETCH,
+        LOOP_FETCH,  // Crossfading out of the loop
+        END_FETCH,  // Crossfading into the end portion
+        NUM_BLOCK_FETCHES
+    };
+
+    /** Transitions that swap the stateful fetches (lowpass streams or stretchers), which happen before a segment is rendered */
+    enum SegmentEvent
+    {
+        NO_EVENT,
+        LOOP_WRAP,  // The main fetch becomes the loop crossfade and restarts at the loop start
+        END_START  // The main fetch becomes the end crossfade and restarts after the loop end
+    };
+
+    /** A run of samples in the block where the voice's state doesn't change, so it can be rendered with a tight loop */
+    struct VoiceSegment
+    {
+        int start{ 0 }, end{ 0 };  // [start, end) in the block
+        SegmentEvent event{ NO_EVENT };
+        double eventPosition{ 0 };  // Where the main fetch restarts after the event
+        bool stopped{ false };
+        bool crossfadingLoop{ false };
+        bool crossfadingEnd{ false };
+    };
+
+    /** Runs the state machine once for the block, recording the fetch positions, crossfade gains and envelope, and splitting
+        the block into segments at every transition (crossfades starting or ending, loop wraps, the end portion, stopping).
+    */
+    void planSegments(int numSamples);
+
+    /** Closes the current segment and starts a new one at the given index */
+    VoiceSegment& startSegment(int start, SegmentEvent event, double eventPosition);
+
+    /** Renders the planned segments for all channels with stateful fetches (lowpass streams, lo-fi resampling or BUNGEE) */
+    void renderSegments(int numSamples);
+
+    /** Renders the planned segments in BUNGEE mode, where the stretchers output every channel at once, a segment at a time */
+    void renderStretchedSegments();
+
+    /** Writes the next output of a stretcher, which comes from the frozen render if the stretcher stands in for it */
+    void nextStretchedBlock(BungeeStretcher& stretcher, float* const* out, int startSample, int numSamples);
+
+    /** Stops playing the frozen render, the stretcher it stood in for picks up live where the render left off */
+    void thawStretcher();
+
+    /** Crossfades a segment of the loop or end stretcher into the output, using the gains recorded for the fetch */
+    void crossfadeStretcher(BungeeStretcher& stretcher, juce::AudioBuffer<float>& stretcherBuffer, BlockFetch fetch, const VoiceSegment& segment);
+
+    /** Prerolls the idle loop and end stretchers to where the next LOOP_WRAP or END_START will start them, a few grains per block,
+        so the transitions don't have to preroll all at once.
+    */
+    void prerollStretchers();
+
+    /** Swaps the fetches of a channel for a LOOP_WRAP or END_START event */
+    void applySegmentEvent(int channel, const VoiceSegment& segment);
+
+    /** Clears the recorded fetches for a new block */
+    void resetBlockFetches(int numSamples);
+
+    /** Records a crossfaded fetch at the given output index, with the gains applied to the current sample and the fetched sample */
+    void recordBlockFetch(BlockFetch fetch, int i, double position, float currentGain, float fetchGain);
+
+    /** Interpolates and mixes the recorded fetches into all the channels of tempOutputBuffer, applying velocity and gain.
+        Reads from the pyramid level if there is one, otherwise from the sample itself, and the loop crossfade from the splice if acquired.
+    */
+    void interpolateBlockFetches(int numSamples);
+
+    /** Scales a channel of tempOutputBuffer by the velocity curve and the sample gain */
+    void applyVelocityAndGain(int channel, int numSamples);
 
     /** Use a Lanczos kernel to calculate fractional sample indices. Applies a lowpass filter beforehand, if doLowpass. */
     float lanczosInterpolate(int channel, double position, std::vector<std::unique_ptr<LowpassStream>>& lowpassStreams) const;
 
-    inline static float lanczosWindow(double x);
-    static constexpr int LANCZOS_WINDOW_SIZE{ 5 };
-
-    /** Initialize or updates (by reinitializing) the effect chain. This is not real-time safe, but I don't think reordering needs to be. */
-    void initializeFx();
+    static constexpr int LANCZOS_WINDOW_SIZE{ Lanczos::WINDOW_SIZE };
 
     //==============================================================================
     int expectedBlockSize;
 
     const SamplerParameters& sampleSound;
+    StretcherPool& stretcherPool;
+    FreezeCache& freezeCache;
     float sampleRateConversion{ 0 };  // Loaded sample rate / application sample rate
     float speed{ 0 };  // Used in BASIC mode
     int effectiveStart{ 0 };
@@ -217,6 +368,7 @@ private:
     int pitchWheel{ 0 };
     float speedFactor{ 0.f };  // Used in ADVANCED mode
     float noteVelocity{ 0.f };
+    double velocityGain{ 1. };  // Computed once per note, note that this is in double precision
 
     bool playUntilEnd{ false };
     bool isLooping{ false }, loopingHasStart{ false }, loopingHasEnd{ false };
@@ -226,26 +378,55 @@ private:
     float attackSmoothing{ 0.f }, releaseSmoothing{ 0.f };
     float attackShape{ 0.f }, releaseShape{ 0.f };
     float crossfade{ 0.f };
+    double crossfadeToIndex{ 0. };  // Converts a position within the crossfade to an index of the crossfadeTable
 
     VoiceContext vc;
+    std::atomic<double> readPosition{ -1. };  // Published once per block, for SampleReadAhead
+    VoiceParamSnapshot params, previousParams;
+    EnvelopeRamp attackRamp, releaseRamp;
     bool midiReleased{ false };
     juce::AudioBuffer<float> tempOutputBuffer;
-    juce::AudioBuffer<float> envelopeBuffer;  // To enable the PRE_FX option, we store the envelope gain here before applying
+    juce::AudioBuffer<float> envelopeBuffer;  // To enable the PRE_FX option, we store the envelope gain here before applying (shared by all channels)
+
+    // Block interpolation state, see BlockFetch
+    juce::AudioBuffer<double> fetchPositionBuffer;
+    juce::AudioBuffer<float> crossfadeGainBuffer;  // For each fetch, the gain of the current sample and the gain of the fetched sample
+    juce::AudioBuffer<float> interpolationBuffer;
+    std::array<bool, NUM_BLOCK_FETCHES> blockFetchUsed{};
+
+    static constexpr int MAX_SEGMENTS_PER_SAMPLE{ 3 };  // A change in state, and then up to two events after the sample
+    std::vector<VoiceSegment> segments;
+    int numSegments{ 0 };
 
     static constexpr int TAIL_OFF = 50;
     int tailOff{ 0 };
     juce::AudioBuffer<float> tailOffBuffer;  // To avoid clicks on voice-stealing, we render a tail
 
-    BungeeStretcher mainStretcher;
-    BungeeStretcher loopStretcher;
-    BungeeStretcher endStretcher;
+    int fadeOutLength{ 1 };
+    int fadeOutRemaining{ 0 };  // The samples left in the fade out, only while fading out
+    std::atomic<bool> haltRequested{ false };  // Set by requestHalt(), the voice halts on the rendering thread
+
+    BungeeStretcher* mainStretcher{ nullptr };  // Only checked out while a BUNGEE note plays
+    BungeeStretcher* loopStretcher{ nullptr };  // Only with isLooping
+    BungeeStretcher* endStretcher{ nullptr };  // Only with loopingHasEnd
+    static constexpr int PREROLL_GRAINS_PER_BLOCK{ 1 };
+    bool loopPrerollStarted{ false };
+    bool endPrerollStarted{ false };
 
-    // Since the stretchers process channels together, buffers are needed to store the output
-    juce::AudioBuffer<float> mainStretcherBuffer;
+    // With FREEZE_BUNGEE, the main stretcher of a note starts out idle, and its output is copied from the key's render instead
+    FreezeCache::Note::Ptr frozenNote;
+    BungeeStretcher* frozenStretcher{ nullptr };  // The stretcher the render stands in for, it can switch roles like any other
+    int frozenIndex{ 0 };
+    float frozenStep{ 0.f };  // How far the render moves through the sample for each output sample
+
+    // The main stretcher writes to the output directly, these hold the other side of a crossfade
     juce::AudioBuffer<float> loopStretcherBuffer;
     juce::AudioBuffer<float> endStretcherBuffer;
 
-    bool doLowpass{ false };
+    bool doLowpass{ false };  // Whether the lowpass streams are in use
+    int pyramidLevel{ -1 };  // The level of the shared pyramid to read from in BASIC mode, values below 1 read the sample itself
+    const LoopSplice::Level* loopSplice{ nullptr };  // Only set while rendering a block that reads the loop crossfade from the shared splice
+    float lowpassFrequency{ 0.f };  // The cutoff the lowpass streams were last designed for
     std::vector<std::unique_ptr<LowpassStream>> mainLowpass;
     std::vector<std::unique_ptr<LowpassStream>> loopLowpass;
     std::vector<std::unique_ptr<LowpassStream>> endLowpass;
@@ -254,9 +435,7 @@ private:
     bool doFxTailOff{ false };
     static constexpr int UPDATE_PARAMS_LENGTH{ 4 };  // After how many process calls should we query for FX params
     int updateFXParamsTimer{ 0 };
-    std::vector<Fx> effects;
+    EffectRack effects;
 
     MTSClient* mtsClient{ nullptr };
 };
-
-static constexpr float INVERSE_SIN_SQUARED{ 1.f / (juce::MathConstants<float>::pi * juce::MathConstants<float>::pi) };
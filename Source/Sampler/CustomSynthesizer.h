@@ -11,6 +11,8 @@
 #pragma once
 #include <JuceHeader.h>
 
+#include "VoiceRenderPool.h"
+
 /** JUCE's voice and sound paradigm is not so helpful for us, so we use a blank sound class and pass in our parameters directly to the voices. */
 class BlankSynthesizerSound final : public juce::SynthesiserSound
 {
@@ -19,7 +21,7 @@ public:
     bool appliesToChannel(int) override { return true; }
 };
 
-/** We add some custom methods because our Synthesizer does not own its voices */
+/** We add some custom methods because our Synthesizer does not own its voices, and to optionally render the voices in parallel */
 class CustomSynthesizer final : public juce::Synthesiser
 {
 public:
@@ -28,4 +30,30 @@ public:
         const juce::ScopedLock sl(lock);
         return voices.removeAndReturn(index);
     }
+
+    /** Renders voices in parallel on a VoiceRenderPool (whose workers are shared by every instance) if shouldRenderInParallel,
+        otherwise inline. Call this when processing is stopped.
+    */
+    void setParallelRendering(bool shouldRenderInParallel, double sampleRate, int blockSize, int numChannels, int maxVoices)
+    {
+        if (!shouldRenderInParallel)
+        {
+            renderPool.reset();
+            return;
+        }
+
+        if (!renderPool)
+            renderPool = std::make_unique<VoiceRenderPool>();
+        renderPool->prepare(sampleRate, blockSize, numChannels, maxVoices);
+    }
+
+protected:
+    void renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples) override
+    {
+        if (!renderPool || !renderPool->render(voices, outputAudio, startSample, numSamples))
+            juce::Synthesiser::renderVoices(outputAudio, startSample, numSamples);
+    }
+
+private:
+    std::unique_ptr<VoiceRenderPool> renderPool;
 };
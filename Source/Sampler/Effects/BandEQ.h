@@ -28,6 +28,11 @@ public:
         filterChain.prepare(spec);
     }
 
+    void reset() override
+    {
+        filterChain.reset();
+    }
+
     void updateParams(float lowFreq, float highFreq, float lowGain, float midGain, float highGain)
     {
         // This possibly has an issue where the frequencies are outside of range on plugin initialization
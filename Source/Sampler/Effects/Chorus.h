@@ -27,6 +27,11 @@ public:
         chorus.prepare(processSpec);
     }
 
+    void reset() override
+    {
+        chorus.reset();
+    }
+
     void updateParams(const SamplerParameters& sampleSound, bool realtime) override
     {
         chorus.setRate(sampleSound.chorusRate->get());
@@ -29,6 +29,12 @@ public:
         }
     }
 
+    void reset() override
+    {
+        for (const auto& channelDistortion : channelDistortions)
+            channelDistortion->reset();
+    }
+
     void updateParams(float density, float highpass, float mix)
     {
         float mappedDensity = density >= 0.f ? juce::jmap<float>(density, 0.2f, 1.f) : juce::jmap<float>(density, -0.5f, 0.f, 0.f, 0.2f);
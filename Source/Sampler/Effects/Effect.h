@@ -17,7 +17,10 @@ class Effect
 {
 public:
     virtual ~Effect() = default;
+    /** Allocates the effect for a channel count and sample rate, this isn't real-time safe */
     virtual void initialize(int numChannels, int fxSampleRate) = 0;
+    /** Clears the effect's state as if it was just initialized, without allocating */
+    virtual void reset() = 0;
     virtual void updateParams(const SamplerParameters& sampleSound, bool modulating = false) = 0;
     virtual void process(juce::AudioBuffer<float>& buffer, int numSamples, int startSample=0) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    EffectRack.h
+    Created: 16 Oct 2026 7:03:18pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "BandEQ.h"
+#include "Chorus.h"
+#include "Distortion.h"
+#include "Effect.h"
+#include "Reverb.h"
+
+/** This struct serves to separate per instance enablement of effects from the effect classes themselves */
+struct Fx
+{
+    Fx(PluginParameters::FxTypes fxType, std::unique_ptr<Effect> fx, juce::AudioParameterBool* enablementSource) :
+        fxType(fxType), fx(std::move(fx)), enablementSource(enablementSource) {}
+
+    /** Whether the effect is enabled and has been allocated, so it can be processed */
+    bool isAvailable() const { return enablementSource->get() && allocated.load(std::memory_order_acquire); }
+
+    PluginParameters::FxTypes fxType;
+    std::unique_ptr<Effect> fx;
+    juce::AudioParameterBool* enablementSource;
+    std::atomic<bool> allocated{ false };  // Set once Effect::initialize() has been called
+    bool enabled{ false };
+    bool locallyDisabled{ false };  // used to avoid empty processing
+};
+
+/** One of each effect type, created up front. The FX order is just a permutation of them, so reordering never allocates, and
+    starting a note only resets the effects.
+
+    The effects' buffers are allocated separately with allocate(), which isn't real-time safe. Until an effect is allocated, it's
+    unavailable and is skipped. Only enabled effects are allocated by default, since a reverb for each voice adds up quickly.
+*/
+class EffectRack final
+{
+public:
+    EffectRack(const SamplerParameters& sampleSound, int expectedBlockSize)
+    {
+        effects.add(new Fx(PluginParameters::DISTORTION, std::make_unique<Distortion>(), sampleSound.distortionEnabled));
+        effects.add(new Fx(PluginParameters::CHORUS, std::make_unique<Chorus>(expectedBlockSize), sampleSound.chorusEnabled));
+        effects.add(new Fx(PluginParameters::REVERB, std::make_unique<Reverb>(), sampleSound.reverbEnabled));
+        effects.add(new Fx(PluginParameters::EQ, std::make_unique<BandEQ>(), sampleSound.eqEnabled));
+        order = sampleSound.getFxOrder();
+    }
+
+    /** Allocates the effects that aren't yet (only the enabled ones, unless onlyEnabled is false). This can be called from the
+        message thread while the audio thread is processing, which will pick up the effects once they're ready.
+    */
+    void allocate(int numChannels, int sampleRate, bool onlyEnabled = true)
+    {
+        for (auto* effect : effects)
+        {
+            if (effect->allocated.load(std::memory_order_acquire) || (onlyEnabled && !effect->enablementSource->get()))
+                continue;
+
+            effect->fx->initialize(numChannels, sampleRate);
+            effect->allocated.store(true, std::memory_order_release);
+        }
+    }
+
+    void updateOrder(const SamplerParameters& sampleSound)
+    {
+        order = sampleSound.getFxOrder();
+    }
+
+    /** Marks every effect as disabled, so the available ones are reset before they're processed again */
+    void disableAll()
+    {
+        for (auto* effect : effects)
+        {
+            effect->enabled = false;
+            effect->locallyDisabled = false;
+        }
+    }
+
+    /** The effects in processing order */
+    Fx& operator[](int index) { return *effects[order[size_t(index)]]; }
+    int size() const { return effects.size(); }
+
+private:
+    juce::OwnedArray<Fx> effects;  // Indexed by FxTypes
+    std::array<PluginParameters::FxTypes, 4> order{};
+};
+
+/** With SHARED_FX, the voices are mixed dry (with their envelopes) and this single FX chain runs on the mix instead, so
+    the cost of the FX doesn't grow with the number of voices. The bus keeps running between notes, so tails ring out.
+*/
+class FxBus final
+{
+public:
+    static constexpr int UPDATE_PARAMS_LENGTH{ 4 };  // After how many blocks should we query for FX params
+
+    /** Allocates every effect, so the bus never has to */
+    FxBus(const SamplerParameters& sampleSound, int numChannels, int sampleRate, int expectedBlockSize) :
+        sampleSound(sampleSound), numChannels(numChannels), rack(sampleSound, expectedBlockSize)
+    {
+        rack.allocate(numChannels, sampleRate, false);
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int numSamples)
+    {
+        // The effects are allocated for the output channels, the buffer can have more (for inputs)
+        if (buffer.getNumChannels() < numChannels)
+            return;
+        busView.setDataToReferTo(buffer.getArrayOfWritePointers(), numChannels, buffer.getNumSamples());
+
+        if (updateParamsTimer == UPDATE_PARAMS_LENGTH)
+            rack.updateOrder(sampleSound);
+
+        for (int i = 0; i < rack.size(); i++)
+        {
+            auto& effect = rack[i];
+            bool enablement = effect.isAvailable();
+            if (!effect.enabled && enablement)
+            {
+                effect.fx->reset();
+                effect.fx->updateParams(sampleSound, false);
+            }
+            effect.enabled = enablement;
+
+            if (effect.enabled)
+            {
+                if (updateParamsTimer == UPDATE_PARAMS_LENGTH)
+                    effect.fx->updateParams(sampleSound, true);
+                effect.fx->process(busView, numSamples);
+            }
+        }
+
+        updateParamsTimer--;
+        if (updateParamsTimer <= 0)
+            updateParamsTimer = UPDATE_PARAMS_LENGTH;
+    }
+
+    /** Called while the bus is unused, so the effects start fresh when it's used again */
+    void bypass()
+    {
+        rack.disableAll();
+    }
+
+private:
+    const SamplerParameters& sampleSound;
+    int numChannels;
+    EffectRack rack;
+    juce::AudioBuffer<float> busView;
+    int updateParamsTimer{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FxBus)
+};
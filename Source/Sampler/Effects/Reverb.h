@@ -31,6 +31,17 @@ public:
             channelGinReverbs[ch]->setSampleRate(float(fxSampleRate));
             channelGinReverbs[ch]->setParameters(0.f, 0.f, 1.f, 0.f, 1.f, 0.f, 0.f);
         }
+        reverbSampleRate = float(fxSampleRate);
+    }
+
+    void reset() override
+    {
+        // Setting the same sample rate flushes the buffers, without resizing them
+        for (const auto& channelGinReverb : channelGinReverbs)
+        {
+            channelGinReverb->setSampleRate(reverbSampleRate);
+            channelGinReverb->setParameters(0.f, 0.f, 1.f, 0.f, 1.f, 0.f, 0.f);
+        }
     }
 
     // The intended ranges of these values are in PluginParameters.h
@@ -82,4 +93,5 @@ public:
 
 private:
     std::vector<std::unique_ptr<gin::SimpleVerb>> channelGinReverbs;
+    float reverbSampleRate{ 0.f };
 };
\ No newline at end of file
@@ -0,0 +1,350 @@
+/*
+  ==============================================================================
+
+    FreezeCache.h
+    Created: 16 Oct 2026 8:31:52pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "LoopSplice.h"
+#include "SamplerParameters.h"
+#include "Stretcher.h"
+#include "../Utilities/ListenableValue.h"
+#include <libMTSClient.h>
+
+/** With FREEZE_BUNGEE, each key's BUNGEE playback is rendered ahead of time on a background thread, so voices can copy it instead
+    of stretching live. A note plays the same every time as long as the pitch wheel is centered and the parameters don't move, so
+    the render only covers what a voice's main stretcher would play from the start of the note, through the first loop crossfade
+    (or to the end). Loops after the first and the end portion are still stretched live.
+
+    A voice falls back to live stretching if its key hasn't been rendered yet, or if the pitch or speed change while it plays.
+
+    Renders take a lot of memory (the whole sample per key, more at slower speeds), so they're capped at MAX_BYTES. The cap is for
+    each loaded sample, so each plugin instance using FREEZE_BUNGEE can take up to MAX_BYTES. The most recently played keys are
+    rendered first, then the keys closest to the root. Once the cache is full, the least recently played keys make room.
+
+    The background thread only runs while FREEZE_BUNGEE and BUNGEE mode are on (see update()), and it sleeps until a parameter that
+    changes the renders does, or until keys are played. A retuning by an MTS-ESP master doesn't notify anything, so it's picked
+    up the next time a key is played.
+*/
+class FreezeCache final : private juce::Thread, private ValueListener<int>, private juce::AudioProcessorParameter::Listener
+{
+public:
+    static constexpr size_t MAX_BYTES{ 256 * 1024 * 1024 };
+    static constexpr int BLOCK_SIZE{ 512 };  // How much is rendered between checks for changed parameters
+    static constexpr int GARBAGE_INTERVAL{ 500 };  // In milliseconds, how often renders that voices were still playing are checked on
+
+    /** What a render was made for: the start and end in the sample, and the pitch and speed */
+    struct Target
+    {
+        double position{ -1. };
+        int end{ -1 };
+        float pitch{ 0.f };
+        float speed{ 0.f };
+
+        bool operator==(const Target& other) const = default;
+    };
+
+    /** A key's render, which doesn't change once it's in the cache */
+    struct Note final : juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<Note>;
+
+        Target target;
+        juce::AudioBuffer<float> render;
+    };
+
+    FreezeCache(SamplerParameters& sampleSound, MTSClient* mtsClient) : Thread("Bungee_Freeze"),
+        sampleSound(sampleSound), mtsClient(mtsClient),
+        parameters{ sampleSound.getPlaybackModeParameter(), sampleSound.freezeBungee, sampleSound.midiStart, sampleSound.midiEnd,
+            sampleSound.midiRoot, sampleSound.followMidiPitch, sampleSound.isLooping, sampleSound.loopingHasStart,
+            sampleSound.crossfadeSamples, sampleSound.semitoneTuning, sampleSound.centTuning, sampleSound.wideTuningControl,
+            sampleSound.pitchWheelRange, sampleSound.speedFactor, sampleSound.octaveSpeedFactor }
+    {
+        for (auto* parameter : parameters)
+            parameter->addListener(this);
+        sampleSound.sampleStart.addListener(this);
+        sampleSound.sampleEnd.addListener(this);
+        sampleSound.loopStart.addListener(this);
+    }
+
+    ~FreezeCache() override
+    {
+        sampleSound.loopStart.removeListener(this);
+        sampleSound.sampleEnd.removeListener(this);
+        sampleSound.sampleStart.removeListener(this);
+        for (auto* parameter : parameters)
+            parameter->removeListener(this);
+        stopThread(-1);
+    }
+
+    /** Where the render of a note ends, so that it covers the main stretcher through the first loop crossfade */
+    static int getRenderEnd(int sampleEnd, bool isLooping, float crossfade)
+    {
+        return sampleEnd + (isLooping ? int(std::ceil(crossfade)) : 0) + 1;
+    }
+
+    /** Sets the application sample rate the renders are made for. If the rate changed, the renders are dropped. */
+    void prepare(int newApplicationSampleRate)
+    {
+        if (newApplicationSampleRate != applicationSampleRate)
+        {
+            stopThread(-1);
+            retireAll();
+            applicationSampleRate = newApplicationSampleRate;
+            stretcher.reset();
+        }
+        update();
+    }
+
+    /** Starts the background thread while FREEZE_BUNGEE and BUNGEE mode are on, and stops it (dropping the renders) once they're
+        not. While it runs, this wakes it up if keys were played or the sample finished loading since the last call. Call this
+        regularly on the message thread.
+    */
+    void update()
+    {
+        const bool shouldRun = applicationSampleRate > 0 && sampleSound.sample.getNumChannels() > 0 &&
+            sampleSound.getPlaybackMode() == PluginParameters::BUNGEE && sampleSound.freezeBungee->get();
+
+        if (!shouldRun)
+        {
+            if (isThreadRunning())
+            {
+                stopThread(-1);
+                retireAll();
+            }
+            collectGarbage();
+            return;
+        }
+
+        if (!isThreadRunning())
+        {
+            if (!stretcher)
+            {
+                stretcher = std::make_unique<BungeeStretcher>(sampleSound.sample, sampleSound.sampleRate);
+                stretcher->preallocateStretcher(applicationSampleRate);
+            }
+            startThread(juce::Thread::Priority::low);
+        }
+
+        const uint32_t played = playCounter.load(std::memory_order_relaxed);
+        const bool loaded = sampleSound.isSampleLoaded();
+        if (played != lastUpdatePlayed || loaded != lastUpdateLoaded)
+            notify();
+        lastUpdatePlayed = played;
+        lastUpdateLoaded = loaded;
+    }
+
+    /** Marks a key as played, which keeps its render around the longest. This is real-time safe. */
+    void notePlayed(int midiNote)
+    {
+        if (midiNote >= 0 && midiNote < 128)
+            lastPlayed[size_t(midiNote)].store(playCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /** Returns the render of a key if it was made for the target, otherwise nullptr. This never blocks, so it's safe on the audio
+        thread. The render stays valid for as long as the pointer is held, and letting go of it never deletes it.
+    */
+    Note::Ptr acquire(int midiNote, const Target& target) const
+    {
+        const juce::SpinLock::ScopedTryLockType lock(notesLock);
+        if (!lock.isLocked() || midiNote < 0 || midiNote >= 128)
+            return nullptr;
+
+        const auto& note = notes[size_t(midiNote)];
+        return note != nullptr && note->target == target ? note : nullptr;
+    }
+
+private:
+    void valueChanged(ListenableValue<int>&, int) override { notify(); }
+    void parameterValueChanged(int, float) override { notify(); }
+    void parameterGestureChanged(int, bool) override {}
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            collectGarbage();
+            bake();
+
+            // Renders that voices were still playing are only let go of once they're done with them
+            wait(retired.isEmpty() ? -1 : GARBAGE_INTERVAL);
+        }
+    }
+
+    /** The render a key needs with the current parameters, or an invalid target if it shouldn't be rendered */
+    Target getTarget(int midiNote) const
+    {
+        Target target;
+        if (!sampleSound.isSampleLoaded() || sampleSound.getPlaybackMode() != PluginParameters::BUNGEE || !sampleSound.freezeBungee->get() ||
+            midiNote < sampleSound.midiStart->get() || midiNote > sampleSound.midiEnd->get())
+            return target;
+
+        const int sampleStart = sampleSound.sampleStart.load();
+        const int sampleEnd = sampleSound.sampleEnd.load();
+        const int loopStart = sampleSound.loopStart.load();
+        if (sampleStart < 0 || sampleEnd >= sampleSound.sample.getNumSamples() || sampleStart > sampleEnd)
+            return target;
+
+        // This mirrors CustomSamplerVoice::startNote, with the pitch wheel centered
+        const bool isLooping = sampleSound.isLooping->get();
+        const bool loopingHasStart = isLooping && sampleSound.loopingHasStart->get() && loopStart < sampleStart;
+        const auto tuning = sampleSound.getTuning(midiNote, 8192, mtsClient);
+
+        target.position = loopingHasStart ? loopStart : sampleStart;
+        target.end = getRenderEnd(sampleEnd, isLooping, LoopSplice::getCrossfade(sampleStart, sampleEnd, sampleSound.crossfadeSamples->get()));
+        target.pitch = tuning.pitch;
+        target.speed = tuning.speed;
+        return target;
+    }
+
+    /** The number of output samples it takes for the target to play from its position past its end */
+    int getRenderLength(const Target& target) const
+    {
+        const float step = target.speed * float(sampleSound.sampleRate / double(applicationSampleRate));
+        return step > 0.f ? int(std::ceil((target.end - target.position) / step)) + 1 : 0;
+    }
+
+    size_t getBytes(int length) const
+    {
+        return size_t(sampleSound.sample.getNumChannels()) * size_t(length) * sizeof(float);
+    }
+
+    /** Renders the keys that are missing, most important first, making room by dropping the least important renders */
+    void bake()
+    {
+        std::array<Target, 128> targets;
+        std::array<int, 128> order{};
+        std::array<int, 128> rank{};
+        int numKeys = 0;
+        for (int i = 0; i < 128; i++)
+        {
+            targets[size_t(i)] = getTarget(i);
+            if (targets[size_t(i)].position >= 0.)
+                order[size_t(numKeys++)] = i;
+        }
+
+        // Renders that don't match the parameters anymore are useless
+        size_t usedBytes = 0;
+        for (int i = 0; i < 128; i++)
+        {
+            if (notes[size_t(i)] != nullptr && notes[size_t(i)]->target != targets[size_t(i)])
+                retire(i);
+            else if (notes[size_t(i)] != nullptr)
+                usedBytes += getBytes(notes[size_t(i)]->render.getNumSamples());
+        }
+
+        const int root = sampleSound.midiRoot->get();
+        std::sort(order.begin(), order.begin() + numKeys, [this, root](int a, int b)
+            {
+                const uint32_t playedA = lastPlayed[size_t(a)].load(std::memory_order_relaxed);
+                const uint32_t playedB = lastPlayed[size_t(b)].load(std::memory_order_relaxed);
+                if (playedA != playedB)
+                    return playedA > playedB;
+                return std::abs(a - root) < std::abs(b - root);
+            });
+        for (int i = 0; i < numKeys; i++)
+            rank[size_t(order[size_t(i)])] = i;
+
+        for (int i = 0; i < numKeys && !threadShouldExit(); i++)
+        {
+            const int key = order[size_t(i)];
+            if (notes[size_t(key)] != nullptr)
+                continue;
+
+            const int length = getRenderLength(targets[size_t(key)]);
+            if (length <= 0 || getBytes(length) > MAX_BYTES)
+                continue;
+
+            // Only keys that matter less than this one can make room for it
+            while (usedBytes + getBytes(length) > MAX_BYTES)
+            {
+                int victim = -1;
+                for (int j = 0; j < 128; j++)
+                    if (notes[size_t(j)] != nullptr && rank[size_t(j)] > i && (victim < 0 || rank[size_t(j)] > rank[size_t(victim)]))
+                        victim = j;
+
+                if (victim < 0)
+                    return;
+                usedBytes -= getBytes(notes[size_t(victim)]->render.getNumSamples());
+                retire(victim);
+            }
+
+            Note::Ptr note = render(key, targets[size_t(key)], length);
+            if (note == nullptr)
+                return;
+
+            const juce::SpinLock::ScopedLockType lock(notesLock);
+            notes[size_t(key)] = note;
+            usedBytes += getBytes(length);
+        }
+    }
+
+    /** Plays the target through the stretcher, returns nullptr if the parameters changed in the meantime */
+    Note::Ptr render(int midiNote, const Target& target, int length)
+    {
+        Note::Ptr note = new Note();
+        note->target = target;
+        note->render.setSize(sampleSound.sample.getNumChannels(), length);
+
+        stretcher->preallocateStretcher(applicationSampleRate, BungeeStretcher::getResamplingOctaves(target.pitch));
+        stretcher->initialize(target.position, target.pitch, target.speed);
+        for (int start = 0; start < length; start += BLOCK_SIZE)
+        {
+            if (threadShouldExit() || getTarget(midiNote) != target)
+                return nullptr;
+            stretcher->nextBlock(note->render.getArrayOfWritePointers(), start, juce::jmin(BLOCK_SIZE, length - start));
+        }
+
+        return note;
+    }
+
+    /** Takes a render out of the cache. Voices can still be playing it, so it's only deleted once they're done. */
+    void retire(int midiNote)
+    {
+        Note::Ptr note;
+        {
+            const juce::SpinLock::ScopedLockType lock(notesLock);
+            std::swap(note, notes[size_t(midiNote)]);
+        }
+
+        if (note != nullptr)
+            retired.add(note);
+    }
+
+    /** Only while the thread is stopped */
+    void retireAll()
+    {
+        for (int i = 0; i < int(notes.size()); i++)
+            retire(i);
+    }
+
+    void collectGarbage()
+    {
+        for (int i = retired.size(); --i >= 0;)
+            if (retired.getObjectPointerUnchecked(i)->getReferenceCount() == 1)
+                retired.remove(i);
+    }
+
+    SamplerParameters& sampleSound;
+    MTSClient* mtsClient;
+    const std::array<juce::RangedAudioParameter*, 15> parameters;  // The ones the renders depend on
+    int applicationSampleRate{ 0 };
+    uint32_t lastUpdatePlayed{ 0 };
+    bool lastUpdateLoaded{ false };
+    std::unique_ptr<BungeeStretcher> stretcher;  // Only used by the background thread, once it's started
+
+    std::array<Note::Ptr, 128> notes;  // Only changed by the background thread (or while it's stopped), with the lock held
+    mutable juce::SpinLock notesLock;
+    juce::ReferenceCountedArray<Note> retired;
+
+    std::array<std::atomic<uint32_t>, 128> lastPlayed{};  // When each note was last played, by playCounter (0 is never)
+    std::atomic<uint32_t> playCounter{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FreezeCache)
+};
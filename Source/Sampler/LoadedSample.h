@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    LoadedSample.h
+    Created: 16 Oct 2026 5:21:09pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "CustomSamplerVoice.h"
+#include "FreezeCache.h"
+#include "SampleCache.h"
+#include "SampleReadAhead.h"
+#include "SamplerParameters.h"
+#include "StretcherPool.h"
+
+/** Everything the audio thread reads for one loaded sample: the sample itself (shared with other instances, along with its
+    pyramid), its SamplerParameters (with its own bounds and the loop splice), and voices that are already prepared for it,
+    along with the stretchers, frozen renders and FX they share.
+
+    Loading a sample builds a new LoadedSample on the message thread, which is then published to the audio thread. The audio
+    thread adopts it at the start of a block and hands the previous one back to be deleted, so a load never holds up processing.
+
+    A sample too large to hold in memory is streamed: the buffer refers to a MappedBuffer, and a SampleReadAhead keeps the parts
+    the voices need locked in memory.
+*/
+struct LoadedSample
+{
+    LoadedSample(const juce::AudioProcessorValueTreeState& apvts, PluginParameters::State& pluginState, std::shared_ptr<SharedSample> sharedSample, MTSClient* mtsClient) :
+        data(std::move(sharedSample)), sample(data->sample), sound(apvts, pluginState, sample, data->sampleRate, data->pyramid),
+        stretchers(sound, mtsClient), freezeCache(sound, mtsClient)
+    {
+        if (data->mappedSample)
+            readAhead = std::make_unique<SampleReadAhead>(sound, *data->mappedSample, voices, numVoices);
+    }
+
+    /** The number of voices that have been created, which any thread can read */
+    int getNumVoices() const { return numVoices.load(std::memory_order_acquire); }
+
+    /** Only valid for index < getNumVoices(), this can be called from any thread while the message thread adds voices */
+    CustomSamplerVoice* getVoice(int index) const { return voices.data()[index]; }
+
+    /** Other instances can be playing the same data, so it must never be modified */
+    std::shared_ptr<SharedSample> data;
+    juce::AudioBuffer<float>& sample;
+    SamplerParameters sound;
+    StretcherPool stretchers;
+    /** The renders of each key for FREEZE_BUNGEE */
+    FreezeCache freezeCache;
+    /** These reference the sound, stretchers and renders, so they're declared after them. Only as many as NUM_VOICES are created,
+        and more are added by the message thread as it's raised. The storage for MAX_VOICES is allocated with the first ones, so
+        adding voices never moves the others, and each is published to the other threads by numVoices once it's ready.
+    */
+    juce::OwnedArray<CustomSamplerVoice> voices;
+    std::atomic<int> numVoices{ 0 };
+    /** The playback sample rate and block size that the voices are prepared for */
+    double playbackRate{ 0. };
+    int blockSize{ 0 };
+    /** The FX chain for SHARED_FX, which runs on the mixed voices instead of in each voice */
+    std::unique_ptr<FxBus> fxBus;
+    /** Only for streamed samples, this reads the voices' positions so it's declared after them */
+    std::unique_ptr<SampleReadAhead> readAhead;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoadedSample)
+};
@@ -0,0 +1,283 @@
+/*
+  ==============================================================================
+
+    LoopSplice.h
+    Created: 16 Oct 2026 4:05:37pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "../PluginParameters.h"
+#include "../Utilities/ListenableValue.h"
+#include "LanczosKernel.h"
+#include "SamplePyramid.h"
+#include <readerwriterqueue.h>
+
+/** The power preserving crossfade curve, sqrt(0.5 - 0.5 * cos(pi * t)) = sin(pi / 2 * t), tabulated once at static
+    initialization. With linear interpolation between the points, gains are within 1e-7 of the exact curve.
+*/
+struct CrossfadeTable
+{
+    static constexpr int RESOLUTION{ 4096 };
+
+    CrossfadeTable()
+    {
+        for (int i = 0; i <= RESOLUTION; i++)
+            gains[i] = float(std::sin(juce::MathConstants<double>::halfPi * i / RESOLUTION));
+    }
+
+    /** Gets the gains of the incoming and outgoing sides at t = index / RESOLUTION, the curve is mirrored for negative t */
+    void getGains(double index, float& increase, float& decrease) const
+    {
+        index = juce::jmin<double>(std::abs(index), RESOLUTION);
+        const int i = juce::jlimit<int>(0, RESOLUTION - 1, int(index));
+        const float fraction = float(index - i);
+        increase = gains[i] + fraction * (gains[i + 1] - gains[i]);
+        decrease = gains[RESOLUTION - i] + fraction * (gains[RESOLUTION - i - 1] - gains[RESOLUTION - i]);
+    }
+
+    float gains[RESOLUTION + 1]{};
+};
+
+inline const CrossfadeTable crossfadeTable{};
+
+/** The loop crossfade of the sample, pre-rendered and shared by all the voices. In the crossfade, a looping voice would otherwise
+    interpolate both the start of the loop and the tail it is fading out of. With the splice, it reads a single stream instead.
+
+    There is a splice for the original sample and one for each level of the SamplePyramid, so voices can keep reading from the
+    level they play at. Gains are applied to whole samples here, not to the interpolated positions, so the fade differs slightly
+    from CustomSamplerVoice's own (by around 1 / crossfade). Short crossfades aren't spliced, since they are cheap anyway.
+
+    When the tail doesn't fall on whole samples, it is interpolated twice (once here, once by the voice). That's inaudible on the
+    band-limited pyramid levels, including the first ones which are filtered but not decimated, but not near the Nyquist frequency,
+    so the original sample is only spliced when the tail lines up.
+
+    The splice is rebuilt on a background thread whenever the loop bounds or the crossfade length change, or when the pyramid
+    finishes building. Like a LoadedSample, a new splice is published to the audio thread, which adopts it with update() at the
+    start of a block and hands the previous one back to be deleted on the background thread. Voices only use it when it was built
+    for the same bounds they're playing.
+*/
+class LoopSplice final : private juce::Thread, private ValueListener<int>, private juce::AudioProcessorParameter::Listener,
+    private SamplePyramid::Listener
+{
+public:
+    struct Level
+    {
+        juce::AudioBuffer<float> data;
+        int first{ 0 };  // Sample j of the data corresponds to sample first + j of the pyramid level
+    };
+
+    static constexpr int MIN_CROSSFADE{ 256 };
+    static constexpr int PADDING{ Lanczos::WINDOW_SIZE + 1 };  // Extra samples on either side, so interpolation near the edges is correct
+
+    LoopSplice(const juce::AudioBuffer<float>& sample, const SamplePyramid& pyramid, ListenableAtomic<int>& sampleStart,
+        ListenableAtomic<int>& sampleEnd, juce::AudioParameterInt* crossfadeSamples, juce::AudioParameterBool* isLooping) :
+        Thread("Loop_Splice"), sample(sample), pyramid(pyramid), sampleStart(sampleStart), sampleEnd(sampleEnd),
+        crossfadeSamples(crossfadeSamples), isLooping(isLooping)
+    {
+        sampleStart.addListener(this);
+        sampleEnd.addListener(this);
+        crossfadeSamples->addListener(this);
+        isLooping->addListener(this);
+        pyramid.addListener(this);
+    }
+
+    ~LoopSplice() override
+    {
+        pyramid.removeListener(this);
+        isLooping->removeListener(this);
+        crossfadeSamples->removeListener(this);
+        sampleEnd.removeListener(this);
+        sampleStart.removeListener(this);
+        stopThread(-1);
+
+        // The audio thread is done with this by now
+        deleteRetired();
+        delete pending.exchange(nullptr);
+        delete active;
+    }
+
+    /** The crossfade length a voice uses for the given bounds */
+    static float getCrossfade(int start, int end, int crossfadeSamples)
+    {
+        return juce::jmin<float>(float(crossfadeSamples), float(end - start + 1) / 2.f + 1);
+    }
+
+    /** Starts building the splice, and rebuilding it when the bounds change. The sample must not be modified after this. */
+    void start()
+    {
+        if (sample.getNumChannels() > 0 && sample.getNumSamples() > 0)
+            startThread(juce::Thread::Priority::low);
+    }
+
+    /** Call this on the audio thread at the start of each block, before any voice renders, to adopt the latest splice */
+    void update()
+    {
+        // The previous splice can only be let go of if there's room to retire it
+        if (pending.load() == nullptr || !retired.try_enqueue(active))
+            return;
+
+        active = pending.exchange(nullptr);
+    }
+
+    /** Returns the splice for a pyramid level (0 for the original sample) if it was built for these bounds, otherwise nullptr.
+        Only call this on the audio thread (or while rendering its block), it stays valid until the next update().
+    */
+    const Level* get(int start, int end, float crossfade, int level) const
+    {
+        if (active && active->bounds.start == start && active->bounds.end == end && juce::exactlyEqual(active->bounds.crossfade, crossfade) &&
+            level < int(active->levels.size()) && active->levels[size_t(level)].data.getNumSamples() > 0)
+            return &active->levels[size_t(level)];
+        return nullptr;
+    }
+
+private:
+    struct Bounds
+    {
+        int start{ -1 }, end{ -1 };
+        float crossfade{ 0.f };
+        int pyramidLevels{ 0 };
+
+        bool operator==(const Bounds& other) const = default;
+    };
+
+    struct Splice
+    {
+        Bounds bounds;
+        std::vector<Level> levels;
+    };
+
+    void valueChanged(ListenableValue<int>&, int) override { notify(); }
+    void parameterValueChanged(int, float) override { notify(); }
+    void parameterGestureChanged(int, bool) override {}
+    void pyramidReady() override { notify(); }
+
+    void run() override
+    {
+        Bounds current;
+        while (!threadShouldExit())
+        {
+            deleteRetired();
+
+            Bounds next;
+            if (isLooping->get())
+            {
+                next.start = sampleStart.load();
+                next.end = sampleEnd.load();
+                next.crossfade = getCrossfade(next.start, next.end, crossfadeSamples->get());
+                next.pyramidLevels = pyramid.isReady() ? pyramid.getNumLevels() : 0;
+            }
+
+            if (next != current)
+            {
+                if (next.crossfade >= MIN_CROSSFADE && next.start >= 0 && next.end < sample.getNumSamples())
+                {
+                    auto splice = build(next);
+                    if (!splice)
+                        return;
+
+                    // A splice the audio thread hasn't adopted yet was never seen by it
+                    delete pending.exchange(splice.release());
+                }
+                current = next;
+            }
+
+            wait(-1);
+        }
+    }
+
+    void deleteRetired()
+    {
+        Splice* splice{ nullptr };
+        while (retired.try_dequeue(splice))
+            delete splice;
+    }
+
+    /** Returns nullptr if the thread should exit */
+    std::unique_ptr<Splice> build(const Bounds& bounds)
+    {
+        auto splice = std::make_unique<Splice>();
+        splice->bounds = bounds;
+        splice->levels.reserve(size_t(bounds.pyramidLevels) + 1);
+        for (int k = 0; k <= bounds.pyramidLevels; k++)
+        {
+            if (k == 0)
+                splice->levels.push_back(tailIsWhole(bounds) ? buildLevel(sample, 1, bounds) : Level());  // See the class description
+            else
+                splice->levels.push_back(buildLevel(pyramid.getLevel(k).data, pyramid.getLevel(k).decimation, bounds));
+
+            if (threadShouldExit())
+                return nullptr;
+        }
+        return splice;
+    }
+
+    static bool tailIsWhole(const Bounds& bounds)
+    {
+        const double tailOffset = float(bounds.end - bounds.start) - bounds.crossfade;
+        return juce::exactlyEqual(tailOffset, std::floor(tailOffset));
+    }
+
+    /** Mixes the start of the loop with the tail it fades out of, exactly as the voice positions them (in original sample coordinates,
+        the tail is sampleEnd - sampleStart - crossfade after the start). The source is the sample or one of the pyramid levels,
+        which can be compact, but the splice itself is always stored as floats.
+    */
+    template <typename Buffer>
+    Level buildLevel(const Buffer& source, int decimation, const Bounds& bounds)
+    {
+        const double scale = 1. / decimation;
+        const double tailOffset = (float(bounds.end - bounds.start) - bounds.crossfade) * scale;
+
+        Level level;
+        level.first = int(std::floor((bounds.start - 1) * scale)) - PADDING;
+        const int last = int(std::ceil((float(bounds.start) + bounds.crossfade) * scale)) + PADDING;
+        const int size = last - level.first;
+        level.data.setSize(source.getNumChannels(), size);
+
+        std::vector<double> tailPositions(size_t(size), 0.);
+        std::vector<float> increase(size_t(size), 1.f), decrease(size_t(size), 0.f);
+        for (int j = 0; j < size; j++)
+        {
+            tailPositions[size_t(j)] = level.first + j + tailOffset;
+
+            double crossfadePosition = double(level.first + j) * decimation - bounds.start;
+            if (crossfadePosition < bounds.crossfade)
+                crossfadeTable.getGains(crossfadePosition * CrossfadeTable::RESOLUTION / bounds.crossfade, increase[size_t(j)], decrease[size_t(j)]);
+        }
+
+        std::vector<float> tail(size_t(size), 0.f);
+        for (int ch = 0; ch < source.getNumChannels(); ch++)
+        {
+            if (threadShouldExit())
+                break;
+
+            Lanczos::interpolateChannel(source, ch, tailPositions.data(), tail.data(), size);
+
+            float* output = level.data.getWritePointer(ch);
+            for (int j = 0; j < size; j++)
+            {
+                int i = level.first + j;
+                float start = i >= 0 && i < source.getNumSamples() ? source.getSample(ch, i) : 0.f;
+                output[j] = start * increase[size_t(j)] + tail[size_t(j)] * decrease[size_t(j)];
+            }
+        }
+
+        return level;
+    }
+
+    const juce::AudioBuffer<float>& sample;
+    const SamplePyramid& pyramid;
+    ListenableAtomic<int>& sampleStart, & sampleEnd;
+    juce::AudioParameterInt* crossfadeSamples;
+    juce::AudioParameterBool* isLooping;
+
+    std::atomic<Splice*> pending{ nullptr };
+    Splice* active{ nullptr };
+    moodycamel::ReaderWriterQueue<Splice*> retired{ 16 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopSplice)
+};
@@ -0,0 +1,199 @@
+/*
+  ==============================================================================
+
+    SampleCache.h
+    Created: 16 Oct 2026 11:52:36pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "SamplePyramid.h"
+#include "../Utilities/BufferUtils.h"
+#include "../Utilities/MappedBuffer.h"
+
+/** A sample and what's derived from it independently of the parameters (the pyramid and the encoded sample), which every instance
+    of the plugin that loads the same sample shares through the SampleCache. It's only written to while it's loading, and is
+    immutable after.
+*/
+struct SharedSample
+{
+    /** The sample as it's stored in the plugin state */
+    struct Encoded
+    {
+        std::shared_ptr<const juce::MemoryBlock> data;
+        bool compressed{ false };  // FLAC, otherwise WAV
+    };
+
+    SharedSample(juce::AudioBuffer<float>&& buffer, int sampleRate, std::unique_ptr<MappedBuffer> mapped = nullptr, const juce::File& file = {}) :
+        mappedSample(std::move(mapped)), sample(std::move(buffer)), sampleRate(sampleRate), file(file)
+    {
+    }
+
+    /** Call this once all of the sample is loaded and hashed. Only the first call builds the pyramid, since other instances might
+        already be reading from it.
+    */
+    void sampleLoaded()
+    {
+        if (!pyramidStarted.exchange(true))
+            pyramid.build(sample);
+    }
+
+    /** Encodes the sample for the plugin state (see encodeBuffer()) the first time it's asked for in a format, so that saving the
+        state again only has to copy it. Other threads asking at the same time wait for it. Only call this once the sample is loaded.
+        If shouldStop interrupts the encoding, nothing is kept and the result is empty.
+    */
+    Encoded getEncoded(bool compressed, int bitsPerSample, const std::function<bool()>& shouldStop = nullptr)
+    {
+        const juce::ScopedLock lock(encodingLock);
+        if (!encoded.data || encodedAs != std::pair{ compressed, bitsPerSample })
+        {
+            auto data = std::make_shared<juce::MemoryBlock>();
+            const bool wasCompressed = encodeBuffer(*data, sample, sampleRate, compressed, bitsPerSample, shouldStop);
+            if (shouldStop && shouldStop())
+                return {};
+
+            encoded.compressed = wasCompressed;
+            encoded.data = std::move(data);
+            encodedAs = { compressed, bitsPerSample };
+        }
+        return encoded;
+    }
+
+    /** Keeps the data that a sample stored in the plugin state was decoded from, so that it isn't encoded again */
+    void setEncoded(std::shared_ptr<const juce::MemoryBlock> data, bool compressed, int bitsPerSample)
+    {
+        const juce::ScopedLock lock(encodingLock);
+        encoded = { std::move(data), compressed };
+        encodedAs = { compressed, bitsPerSample };
+    }
+
+    /** The file a streamed sample refers to, which has to outlive the sample */
+    std::unique_ptr<MappedBuffer> mappedSample;
+    juce::AudioBuffer<float> sample;
+    const int sampleRate;
+    /** The file the sample was loaded from, if it wasn't recorded or stored in the plugin state */
+    const juce::File file;
+    /** Empty until the sample is loaded */
+    juce::String hash;
+    /** Band-limited copies of the sample for playback above the original speed, built in sampleLoaded() */
+    SamplePyramid pyramid;
+
+private:
+    std::atomic<bool> pyramidStarted{ false };
+
+    juce::CriticalSection encodingLock;
+    Encoded encoded;
+    std::pair<bool, int> encodedAs{ false, 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedSample)
+};
+
+/** Samples that are loaded in any instance of the plugin, so that instances loading the same file or the same saved sample can
+    share it instead of decoding it again. Use it through a juce::SharedResourcePointer, so there's one for the whole process.
+
+    Only complete samples are added, and the cache doesn't keep them alive: a sample is freed when the last instance using it
+    loads something else. Files are looked up by their path, modification time and size, so a file that was changed on disk is
+    loaded again.
+
+    It also encodes samples for the plugin state on a background thread, right after they're loaded.
+*/
+class SampleCache final : private juce::Thread
+{
+public:
+    SampleCache() : Thread("Sample_Encoder")
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    ~SampleCache() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(-1);
+    }
+
+    /** Finds a sample that was loaded from the file, if the file hasn't changed since */
+    std::shared_ptr<SharedSample> find(const juce::File& file) const
+    {
+        const juce::ScopedLock lock(cacheLock);
+        const auto entry = byFile.find(getFileKey(file));
+        return entry != byFile.end() ? entry->second.lock() : nullptr;
+    }
+
+    /** Finds a sample with the hash, which can have been loaded from anywhere */
+    std::shared_ptr<SharedSample> find(const juce::String& hash) const
+    {
+        if (hash.isEmpty())
+            return nullptr;
+
+        const juce::ScopedLock lock(cacheLock);
+        const auto entry = byHash.find(hash);
+        return entry != byHash.end() ? entry->second.lock() : nullptr;
+    }
+
+    /** Makes a sample available to other instances, once it's completely loaded and hashed */
+    void add(const std::shared_ptr<SharedSample>& sample)
+    {
+        jassert(sample->hash.isNotEmpty());
+
+        const juce::ScopedLock lock(cacheLock);
+        std::erase_if(byFile, [](const auto& entry) { return entry.second.expired(); });
+        std::erase_if(byHash, [](const auto& entry) { return entry.second.expired(); });
+
+        byHash[sample->hash] = sample;
+        if (sample->file.getFullPathName().isNotEmpty())
+            byFile[getFileKey(sample->file)] = sample;
+    }
+
+    /** Calls SharedSample::getEncoded() in the background, unless the sample is freed first */
+    void encodeInBackground(const std::shared_ptr<SharedSample>& sample, bool compressed, int bitsPerSample)
+    {
+        {
+            const juce::ScopedLock lock(cacheLock);
+            toEncode.push_back({ sample, compressed, bitsPerSample });
+        }
+        notify();
+    }
+
+private:
+    struct EncodingRequest
+    {
+        std::weak_ptr<SharedSample> sample;
+        bool compressed{ false };
+        int bitsPerSample{ 0 };
+    };
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            std::optional<EncodingRequest> request;
+            {
+                const juce::ScopedLock lock(cacheLock);
+                if (!toEncode.empty())
+                {
+                    request = toEncode.front();
+                    toEncode.erase(toEncode.begin());
+                }
+            }
+
+            if (!request)
+                wait(-1);
+            else if (auto sample = request->sample.lock())
+                sample->getEncoded(request->compressed, request->bitsPerSample, [this] { return threadShouldExit(); });
+        }
+    }
+
+    static juce::String getFileKey(const juce::File& file)
+    {
+        return file.getFullPathName() + "|" + juce::String(file.getLastModificationTime().toMilliseconds()) + "|" + juce::String(file.getSize());
+    }
+
+    juce::CriticalSection cacheLock;
+    std::map<juce::String, std::weak_ptr<SharedSample>> byFile, byHash;
+    std::vector<EncodingRequest> toEncode;
+};
@@ -0,0 +1,229 @@
+/*
+  ==============================================================================
+
+    SamplePyramid.h
+    Created: 16 Oct 2026 1:48:22pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "../Utilities/CompactBuffer.h"
+
+#ifndef JAS_COMPACT_PYRAMID
+#define JAS_COMPACT_PYRAMID false
+#endif
+
+/** Following juce::dsp::FilterDesign::designIIRLowpassHighOrderButterworthMethod(), these are the four stages of an 8th order
+    Butterworth lowpass, which is theoretically -48db an octave above the frequency.
+*/
+inline std::array<juce::IIRCoefficients, 4> makeLowpassStages(double sampleRate, double frequency)
+{
+    constexpr double order = 8.;
+    std::array<juce::IIRCoefficients, 4> stages;
+    for (int i = 0; i < int(stages.size()); i++)
+        stages[size_t(i)] = juce::IIRCoefficients::makeLowPass(sampleRate, frequency, 1. / (2. * std::cos((2. * i + 1.) * juce::MathConstants<double>::pi / (order * 2.))));
+    return stages;
+}
+
+/** A band-limited "mip pyramid" of the sample, shared by all the voices. Level k is lowpassed for playback at up to
+    2^(k / LEVELS_PER_OCTAVE) times the original speed, so voices read from the right level instead of filtering the sample
+    themselves while rendering. Level 0 is the original sample, which isn't stored here.
+
+    Higher levels need less bandwidth, so each octave is decimated by another factor of 2. This keeps the pyramid to about
+    2 * LEVELS_PER_OCTAVE times the size of the sample, and it is never larger than MAX_MEMORY (the top levels are dropped).
+
+    The pyramid is built on a background thread whenever the sample changes. Until isReady(), voices fall back to LowpassStream.
+
+    With JAS_COMPACT_PYRAMID the levels are stored as 16-bit CompactBuffers, which halves their size (so long samples keep more
+    of their levels under MAX_MEMORY). The levels are already lowpassed, and the quantization noise is about 90db below each
+    channel's peak. Only the levels are compact: the sample itself stays float, since Bungee, the editor, the pitch detector and
+    the plugin state all read it directly, and streamed samples are mapped from a float file.
+*/
+class SamplePyramid final : private juce::Thread
+{
+public:
+    using LevelBuffer = std::conditional_t<JAS_COMPACT_PYRAMID, CompactBuffer, juce::AudioBuffer<float>>;
+
+    struct Level
+    {
+        LevelBuffer data;
+        int decimation{ 1 };  // Sample i of the level corresponds to sample i * decimation of the original
+    };
+
+    /** Notified on the pyramid's thread once it's ready */
+    struct Listener
+    {
+        virtual ~Listener() = default;
+        virtual void pyramidReady() = 0;
+    };
+
+    static constexpr int LEVELS_PER_OCTAVE{ 2 };
+    static constexpr int MAX_OCTAVES{ 6 };
+    static constexpr size_t MAX_MEMORY{ size_t(256) * 1024 * 1024 };  // in bytes
+    static constexpr int CHUNK_SIZE{ 1 << 16 };  // The number of samples processed between checks for the thread exiting
+
+    SamplePyramid() : Thread("Sample_Pyramid") {}
+
+    ~SamplePyramid() override
+    {
+        stopThread(-1);
+    }
+
+    /** Stops any build in progress and discards the levels. Call this before the sample buffer is modified. */
+    void clear()
+    {
+        stopThread(-1);
+        ready = false;
+        levels.clear();
+        source = nullptr;
+    }
+
+    /** Starts building the pyramid in the background. The sample must not be modified until the next clear(). */
+    void build(const juce::AudioBuffer<float>& sample)
+    {
+        clear();
+        if (sample.getNumChannels() == 0 || sample.getNumSamples() == 0)
+            return;
+
+        source = &sample;
+        startThread(juce::Thread::Priority::low);
+    }
+
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+
+    void addListener(Listener* listener) const { listeners.add(listener); }
+    void removeListener(Listener* listener) const { listeners.remove(listener); }
+
+    /** Returns the level to play from at a given speed, 0 for the original sample, or -1 if the speed is past the top level.
+        Only valid when isReady().
+    */
+    int getLevelForSpeed(float speed) const
+    {
+        if (speed <= 1.f)
+            return 0;
+
+        int level = int(std::ceil(LEVELS_PER_OCTAVE * std::log2(speed) - 1e-4f));  // Never filter above the new Nyquist frequency
+        return level <= int(levels.size()) ? level : -1;
+    }
+
+    /** The number of levels above the original sample, only valid when isReady() */
+    int getNumLevels() const { return int(levels.size()); }
+
+    /** Only valid when isReady(), for level > 0 */
+    const Level& getLevel(int level) const
+    {
+        jassert(level > 0 && level <= int(levels.size()));
+        return levels[size_t(level - 1)];
+    }
+
+private:
+    void run() override
+    {
+        const int numChannels = source->getNumChannels();
+        const int numSamples = source->getNumSamples();
+
+        const int maxLevels = LEVELS_PER_OCTAVE * MAX_OCTAVES;
+        levels.reserve(maxLevels);
+
+        std::vector<float> filtered, decimated;
+        size_t memoryUsed = 0;
+        for (int k = 1; k <= maxLevels; k++)
+        {
+            // Each level is filtered from the level an octave below, which is already band-limited and decimated by half as much
+            const bool fromSource = k <= LEVELS_PER_OCTAVE;
+            const int inputDecimation = fromSource ? 1 : levels[size_t(k - LEVELS_PER_OCTAVE - 1)].decimation;
+
+            Level level;
+            level.decimation = 1 << ((k - 1) / LEVELS_PER_OCTAVE);
+            const int step = level.decimation / inputDecimation;
+            const int levelSize = (numSamples + level.decimation - 1) / level.decimation;
+
+            memoryUsed += size_t(numChannels) * size_t(levelSize) * (JAS_COMPACT_PYRAMID ? sizeof(int16_t) : sizeof(float));
+            if (memoryUsed > MAX_MEMORY)
+                break;
+
+            level.data.setSize(numChannels, levelSize);
+
+            // The frequencies here are normalized to the input's sample rate
+            const double speedLimit = std::pow(2., double(k) / LEVELS_PER_OCTAVE) / inputDecimation;
+            const auto stages = makeLowpassStages(1., 0.5 / speedLimit);
+
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                if (threadShouldExit())
+                    return;
+
+                // Filtering forwards and then backwards means the levels have no phase shift, so voices can switch between them freely
+                if (fromSource)
+                    readChannel(*source, ch, filtered);
+                else
+                    readChannel(levels[size_t(k - LEVELS_PER_OCTAVE - 1)].data, ch, filtered);
+                if (!filterInPlace(filtered, stages))
+                    return;
+                std::reverse(filtered.begin(), filtered.end());
+                if (!filterInPlace(filtered, stages))
+                    return;
+                std::reverse(filtered.begin(), filtered.end());
+
+                decimated.resize(size_t(levelSize));
+                for (int start = 0; start < levelSize; start += CHUNK_SIZE)
+                {
+                    if (threadShouldExit())
+                        return;
+
+                    for (int i = start; i < juce::jmin(start + CHUNK_SIZE, levelSize); i++)
+                        decimated[size_t(i)] = filtered[juce::jmin<size_t>(size_t(i) * size_t(step), filtered.size() - 1)];
+                }
+                level.data.copyFrom(ch, 0, decimated.data(), levelSize);
+            }
+
+            levels.push_back(std::move(level));
+        }
+
+        ready.store(true, std::memory_order_release);
+        listeners.call([](Listener& listener) { listener.pyramidReady(); });
+    }
+
+    static void readChannel(const juce::AudioBuffer<float>& buffer, int channel, std::vector<float>& samples)
+    {
+        samples.assign(buffer.getReadPointer(channel), buffer.getReadPointer(channel) + buffer.getNumSamples());
+    }
+
+    static void readChannel(const CompactBuffer& buffer, int channel, std::vector<float>& samples)
+    {
+        samples.resize(size_t(buffer.getNumSamples()));
+        for (int i = 0; i < buffer.getNumSamples(); i++)
+            samples[size_t(i)] = buffer.getSample(channel, i);
+    }
+
+    /** Runs the samples through the stages a chunk at a time, returning false if the thread should exit before it's done */
+    bool filterInPlace(std::vector<float>& samples, const std::array<juce::IIRCoefficients, 4>& stages) const
+    {
+        std::array<juce::SingleThreadedIIRFilter, 4> filters;
+        for (size_t i = 0; i < stages.size(); i++)
+            filters[i].setCoefficients(stages[i]);
+
+        const int numSamples = int(samples.size());
+        for (int start = 0; start < numSamples; start += CHUNK_SIZE)
+        {
+            if (threadShouldExit())
+                return false;
+
+            const int chunkSize = juce::jmin(CHUNK_SIZE, numSamples - start);
+            for (auto& filter : filters)
+                filter.processSamples(samples.data() + start, chunkSize);
+        }
+        return true;
+    }
+
+    const juce::AudioBuffer<float>* source{ nullptr };
+    std::vector<Level> levels;
+    std::atomic<bool> ready{ false };
+    mutable juce::ListenerList<Listener, juce::Array<Listener*, juce::CriticalSection>> listeners;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePyramid)
+};
@@ -0,0 +1,181 @@
+/*
+  ==============================================================================
+
+    SampleReadAhead.h
+    Created: 16 Oct 2026 9:58:40pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "CustomSamplerVoice.h"
+#include "LoopSplice.h"
+#include "SamplerParameters.h"
+#include "../Utilities/MappedBuffer.h"
+
+/** Keeps the parts of a streamed sample (see MappedBuffer) that the voices are about to read locked in memory, so the audio
+    thread never waits on the disk. Every POLL_INTERVAL, it locks the READ_AHEAD after each playing voice, along with the head of
+    the sample where notes start and the places the loop jumps to, and releases what's no longer needed. Everything else is left
+    for the OS to page out, so the memory used doesn't depend on the length of the sample. The voices' positions change with
+    every block, so this polls them instead of waiting to be told.
+
+    The windows are rounded out to LOCK_STEP, so that they only change every so often and most polls lock nothing new. If the OS
+    won't lock any more memory, the window is read through instead, which loads it but doesn't stop the OS from paging it out.
+*/
+class SampleReadAhead final : private juce::Thread
+{
+public:
+    static constexpr double READ_AHEAD{ 2. };  // In seconds of playback
+    static constexpr double PRELOAD{ 2. };  // In seconds of the sample, kept in memory wherever a voice can start or jump to
+    static constexpr int POLL_INTERVAL{ 10 };  // In milliseconds
+    static constexpr int LOCK_STEP{ 1 << 14 };  // In samples
+    static constexpr int PAGE_SAMPLES{ 4096 / int(sizeof(float)) };  // Reading one sample of each page is enough to load it
+
+    /** numVoices is the number of voices that have been created, which can grow while the thread runs (see LoadedSample) */
+    SampleReadAhead(const SamplerParameters& sampleSound, MappedBuffer& mappedSample, const juce::OwnedArray<CustomSamplerVoice>& voices,
+        const std::atomic<int>& numVoices) :
+        Thread("Sample_Read_Ahead"), sampleSound(sampleSound), mappedSample(mappedSample), voices(voices), numVoices(numVoices)
+    {
+    }
+
+    ~SampleReadAhead() override
+    {
+        stop();
+    }
+
+    /** Voices can be added while the thread is running, but stop() it before they're recreated */
+    void start()
+    {
+        lastPositions.assign(size_t(PluginParameters::MAX_VOICES), -1.);
+        lastPoll = juce::Time::getMillisecondCounterHiRes();
+        startThread(juce::Thread::Priority::high);
+    }
+
+    /** Stops the thread and releases everything it locked */
+    void stop()
+    {
+        stopThread(-1);
+        for (const auto& range : locked)
+            mappedSample.unlock(range.getStart(), range.getEnd());
+        locked.clear();
+    }
+
+private:
+    using Window = juce::Range<int>;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wanted.clear();
+
+            const int sampleRate = juce::jmax(sampleSound.sampleRate, 1);
+            const int preload = int(PRELOAD * sampleRate);
+            const int sampleStart = sampleSound.sampleStart.load();
+            const int sampleEnd = sampleSound.sampleEnd.load();
+            const bool isLooping = sampleSound.isLooping->get();
+
+            // Where notes start, and where looping voices jump back to or release into
+            want(isLooping && sampleSound.loopingHasStart->get() ? juce::jmin(sampleSound.loopStart.load(), sampleStart) : sampleStart, preload);
+            if (isLooping)
+            {
+                const int crossfade = int(std::ceil(LoopSplice::getCrossfade(sampleStart, sampleEnd, sampleSound.crossfadeSamples->get())));
+                want(sampleStart - crossfade, preload + crossfade);
+                if (sampleSound.loopingHasEnd->get())
+                    want(sampleEnd + 1, preload);
+            }
+
+            // Voices moving faster than the original speed need more of the sample, which is estimated from how far they moved
+            const double now = juce::Time::getMillisecondCounterHiRes();
+            const double elapsed = juce::jmax(now - lastPoll, 1.) / 1000. * sampleRate;
+            lastPoll = now;
+            const int numCreated = juce::jmin(numVoices.load(std::memory_order_acquire), int(lastPositions.size()));
+            for (int i = 0; i < numCreated; i++)
+            {
+                const double position = voices.data()[i]->getReadPosition();
+                const double lastPosition = std::exchange(lastPositions[size_t(i)], position);
+                if (position < 0.)
+                    continue;
+
+                const double speed = lastPosition >= 0. && position > lastPosition ? juce::jmax((position - lastPosition) / elapsed, 1.) : 1.;
+                want(int(position), int(READ_AHEAD * sampleRate * speed));
+            }
+
+            updateLocks();
+            wait(POLL_INTERVAL);
+        }
+    }
+
+    void want(int start, int length)
+    {
+        const int first = juce::jlimit(0, mappedSample.getNumSamples(), start) / LOCK_STEP * LOCK_STEP;
+        const int last = juce::jlimit(first, mappedSample.getNumSamples(), start + length);
+        if (last > first)
+            wanted.emplace_back(first, juce::jmin((last + LOCK_STEP - 1) / LOCK_STEP * LOCK_STEP, mappedSample.getNumSamples()));
+    }
+
+    /** Locks the windows that are wanted and weren't locked at the last poll, then releases the ones that aren't wanted anymore.
+        Since each page's locks are counted, pages in both stay locked throughout.
+    */
+    void updateLocks()
+    {
+        const auto isBefore = [](const Window& a, const Window& b) {
+            return a.getStart() < b.getStart() || (a.getStart() == b.getStart() && a.getEnd() < b.getEnd());
+        };
+        std::sort(wanted.begin(), wanted.end(), isBefore);
+        wanted.erase(std::unique(wanted.begin(), wanted.end(), [&](const Window& a, const Window& b) { return !isBefore(a, b) && !isBefore(b, a); }),
+            wanted.end());
+
+        std::vector<Window> added, released, kept;
+        std::set_difference(wanted.begin(), wanted.end(), locked.begin(), locked.end(), std::back_inserter(added), isBefore);
+        std::set_difference(locked.begin(), locked.end(), wanted.begin(), wanted.end(), std::back_inserter(released), isBefore);
+        std::set_intersection(locked.begin(), locked.end(), wanted.begin(), wanted.end(), std::back_inserter(kept), isBefore);
+
+        for (const auto& range : added)
+        {
+            if (threadShouldExit())
+                break;
+
+            if (mappedSample.lock(range.getStart(), range.getEnd()))
+                kept.push_back(range);
+            else
+                touch(range);
+        }
+
+        for (const auto& range : released)
+            mappedSample.unlock(range.getStart(), range.getEnd());
+
+        std::sort(kept.begin(), kept.end(), isBefore);
+        locked = std::move(kept);
+    }
+
+    /** Reads one sample of each page in the range, so the OS loads the pages that were paged out */
+    void touch(const Window& range)
+    {
+        const auto& sample = sampleSound.sample;
+        float sum = 0.f;
+        for (int ch = 0; ch < sample.getNumChannels() && !threadShouldExit(); ch++)
+        {
+            const float* data = sample.getReadPointer(ch);
+            for (int i = range.getStart(); i < range.getEnd(); i += PAGE_SAMPLES)
+                sum += data[i];
+        }
+        sink = sum;
+    }
+
+    const SamplerParameters& sampleSound;
+    MappedBuffer& mappedSample;
+    const juce::OwnedArray<CustomSamplerVoice>& voices;
+    const std::atomic<int>& numVoices;
+
+    std::vector<double> lastPositions;  // Each voice's position at the last poll, -1 if it wasn't playing
+    double lastPoll{ 0. };
+    std::vector<Window> wanted;  // The windows to keep in memory, rebuilt at every poll
+    std::vector<Window> locked;  // The windows that are locked, sorted
+    volatile float sink{ 0.f };  // Keeps the reads in touch() from being optimized out
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleReadAhead)
+};
@@ -10,8 +10,9 @@
 
 #include "SamplerParameters.h"
 
-SamplerParameters::SamplerParameters(const juce::AudioProcessorValueTreeState& apvts, PluginParameters::State& pluginState, const juce::AudioBuffer<float>& sample, int sampleRate) : 
-    sample(sample), sampleRate(sampleRate),
+SamplerParameters::SamplerParameters(const juce::AudioProcessorValueTreeState& apvts, PluginParameters::State& pluginState, const juce::AudioBuffer<float>& sample, int sampleRate,
+    const SamplePyramid& pyramid) : 
+    sample(sample), sampleRate(sampleRate), pyramid(pyramid),
     gain(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::SAMPLE_GAIN))),
     speedFactor(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::SPEED_FACTOR))),
     octaveSpeedFactor(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::OCTAVE_SPEED_FACTOR))),
@@ -37,18 +38,21 @@ SamplerParameters::SamplerParameters(const juce::AudioProcessorValueTreeState& a
     isLooping(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::IS_LOOPING))),
     loopingHasStart(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::LOOPING_HAS_START))),
     loopingHasEnd(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::LOOPING_HAS_END))),
+    freezeBungee(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::FREEZE_BUNGEE))),
 
-    sampleStart(pluginState.sampleStart), sampleEnd(pluginState.sampleEnd),
-    loopStart(pluginState.loopStart), loopEnd(pluginState.loopEnd),
+    sampleStart(pluginState.sampleStart.load()), sampleEnd(pluginState.sampleEnd.load()),
+    loopStart(pluginState.loopStart.load()), loopEnd(pluginState.loopEnd.load()),
     midiStart(dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(PluginParameters::MIDI_START))),
     midiEnd(dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(PluginParameters::MIDI_END))),
     midiRoot(dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(PluginParameters::MIDI_ROOT))),
     followMidiPitch(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::FOLLOW_MIDI_PITCH))),
+    loopSplice(sample, pyramid, sampleStart, sampleEnd, crossfadeSamples, isLooping),
 
     reverbEnabled(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::REVERB_ENABLED))),
     distortionEnabled(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::DISTORTION_ENABLED))),
     eqEnabled(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::EQ_ENABLED))),
     chorusEnabled(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::CHORUS_ENABLED))),
+    sharedFX(dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(PluginParameters::SHARED_FX))),
 
     reverbMix(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::REVERB_MIX))),
     reverbSize(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::REVERB_SIZE))),
@@ -73,14 +77,67 @@ SamplerParameters::SamplerParameters(const juce::AudioProcessorValueTreeState& a
     chorusFeedback(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::CHORUS_FEEDBACK))),
     chorusCenterDelay(dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(PluginParameters::CHORUS_CENTER_DELAY))),
 
+    pluginState(pluginState),
     playbackMode(dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter(PluginParameters::PLAYBACK_MODE))),
     fxOrder(dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(PluginParameters::FX_PERM)))
 {
+    // Bounds that don't fit belong to the previous sample, the whole sample plays until the state sets this one's
+    if (sampleStart.load() < 0 || sampleEnd.load() >= sample.getNumSamples() || sampleStart.load() > sampleEnd.load() ||
+        loopStart.load() < 0 || loopEnd.load() >= sample.getNumSamples())
+    {
+        sampleStart = 0;
+        sampleEnd = sample.getNumSamples() - 1;
+        loopStart = 0;
+        loopEnd = sample.getNumSamples() - 1;
+    }
+
+    pluginState.sampleStart.addListener(this);
+    pluginState.sampleEnd.addListener(this);
+    pluginState.loopStart.addListener(this);
+    pluginState.loopEnd.addListener(this);
+}
+
+SamplerParameters::~SamplerParameters()
+{
+    stopFollowingBounds();
+}
+
+void SamplerParameters::stopFollowingBounds()
+{
+    if (!followingBounds)
+        return;
+
+    pluginState.loopEnd.removeListener(this);
+    pluginState.loopStart.removeListener(this);
+    pluginState.sampleEnd.removeListener(this);
+    pluginState.sampleStart.removeListener(this);
+    followingBounds = false;
+}
+
+void SamplerParameters::valueChanged(ListenableValue<int>& source, int newValue)
+{
+    if (&source == &pluginState.sampleStart)
+        sampleStart = newValue;
+    else if (&source == &pluginState.sampleEnd)
+        sampleEnd = newValue;
+    else if (&source == &pluginState.loopStart)
+        loopStart = newValue;
+    else if (&source == &pluginState.loopEnd)
+        loopEnd = newValue;
 }
 
-void SamplerParameters::sampleChanged(const int newSampleRate)
+void SamplerParameters::sampleChanged(const int newSampleRate, const bool isLoading)
 {
     sampleRate = newSampleRate;
+    loaded = false;
+    if (!isLoading)
+        sampleLoaded();
+}
+
+void SamplerParameters::sampleLoaded()
+{
+    loopSplice.start();
+    loaded.store(true, std::memory_order_release);
 }
 
 PluginParameters::PLAYBACK_MODES SamplerParameters::getPlaybackMode() const
@@ -92,3 +149,34 @@ std::array<PluginParameters::FxTypes, 4> SamplerParameters::getFxOrder() const
 {
     return PluginParameters::paramToPerm(fxOrder->get());
 }
+
+SamplerParameters::Tuning SamplerParameters::getTuning(int midiNote, int pitchWheelPosition, MTSClient* mtsClient, bool wavetableMode) const
+{
+    // Account for tuning adjustments, summed in semitones so that there's only one exponential. This rounds differently from
+    // multiplying a ratio for each adjustment, the pitch can differ from that by up to about 1e-6 (a 500th of a cent).
+    float semitones;
+    if (wavetableMode)
+        semitones = float(waveformSemitoneTuning->get()) + float(waveformCentTuning->get()) / 100.f;
+    else
+        semitones = float(semitoneTuning->get()) + float(centTuning->get()) / 100.f;
+
+    float wheelRange = pitchWheelRange->get();
+    semitones += juce::jmap<float>(float(pitchWheelPosition), 0.f, 16383.f, -wheelRange, wheelRange);
+
+    semitones += wideTuningControl->get();
+
+    // Account for MIDI note
+    float tuningRatio = 1.f;
+    if (followMidiPitch->get())
+    {
+        int rootNote = midiRoot->get();
+        semitones += float(midiNote - rootNote);
+        tuningRatio = float(MTS_RetuningAsRatio(mtsClient, char(midiNote), -1));
+    }
+
+    Tuning tuning{};
+    tuning.pitch = tuningRatio * std::exp2(semitones / 12.f);
+    tuning.speed = speedFactor->get();
+    tuning.speed *= 1.f + (tuning.pitch - 1.f) * octaveSpeedFactor->get();
+    return tuning;
+}
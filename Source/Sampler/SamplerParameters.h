@@ -12,42 +12,86 @@
 #include <JuceHeader.h>
 
 #include "../PluginParameters.h"
+#include "SamplePyramid.h"
+#include "LoopSplice.h"
+#include <libMTSClient.h>
 
 /** A class defining all parameters for a note played by CustomSamplerVoice.cpp */
-class SamplerParameters final
+class SamplerParameters final : private ValueListener<int>
 {
 public:
-    SamplerParameters(const juce::AudioProcessorValueTreeState& apvts, PluginParameters::State& pluginState, const juce::AudioBuffer<float>& sample, int sampleRate);
+    SamplerParameters(const juce::AudioProcessorValueTreeState& apvts, PluginParameters::State& pluginState, const juce::AudioBuffer<float>& sample, int sampleRate,
+        const SamplePyramid& pyramid);
+    ~SamplerParameters() override;
 
-    void sampleChanged(int newSampleRate);
+    /** Call this when a newer sample is loaded, before the plugin state's bounds are set for it. From then on this sample keeps
+        the bounds it has, so the voices still playing it never see bounds that were meant for the newer one.
+    */
+    void stopFollowingBounds();
+
+    /** Call this when the sample changes. A sample that's still loading reads as silence past what's loaded, so the loop splice
+        waits until sampleLoaded().
+    */
+    void sampleChanged(int newSampleRate, bool isLoading = false);
+
+    /** Call this once a sample that was still loading is complete */
+    void sampleLoaded();
+
+    /** Whether all of the sample is loaded */
+    bool isSampleLoaded() const { return loaded.load(std::memory_order_acquire); }
 
     /** Fetch the playback mode, as the proper enum type */
     PluginParameters::PLAYBACK_MODES getPlaybackMode() const;
 
+    /** The playback mode parameter itself, for listening to */
+    juce::AudioParameterChoice* getPlaybackModeParameter() const { return playbackMode; }
+
     /** Fetch the sound's FX chain permutation */
     std::array<PluginParameters::FxTypes, 4> getFxOrder() const;
 
+    /** The pitch ratio and speed factor a note plays at */
+    struct Tuning
+    {
+        float pitch;
+        float speed;
+    };
+
+    /** Calculates the tuning of a note from the tuning parameters, the pitch wheel and MTS-ESP */
+    Tuning getTuning(int midiNote, int pitchWheelPosition, MTSClient* mtsClient, bool wavetableMode = false) const;
+
     /** The sound to play */
     const juce::AudioBuffer<float>& sample;
     int sampleRate;
+    /** Band-limited copies of the sample for playback above the original speed, built once the sample is loaded (see SharedSample) */
+    const SamplePyramid& pyramid;
 
     /** Playback details */
     juce::AudioParameterFloat* gain, * speedFactor, * octaveSpeedFactor, * attack, * release, * attackShape, * releaseShape, * a4_freq, * pitchWheelRange, * wideTuningControl;
     juce::AudioParameterInt* semitoneTuning, * centTuning, * waveformSemitoneTuning, * waveformCentTuning, * crossfadeSamples;
-    juce::AudioParameterBool* monoOutput, * disableVelocity, * skipAntialiasing, * applyFXPre, * playUntilEnd, * disableWavetableMode, * isLooping, * loopingHasStart, * loopingHasEnd;
-    ListenableAtomic<int>& sampleStart, & sampleEnd, & loopStart, & loopEnd;
+    juce::AudioParameterBool* monoOutput, * disableVelocity, * skipAntialiasing, * applyFXPre, * playUntilEnd, * disableWavetableMode, * isLooping, * loopingHasStart, * loopingHasEnd, * freezeBungee;
+    /** This sample's bounds, which follow the plugin state's until stopFollowingBounds() */
+    ListenableAtomic<int> sampleStart, sampleEnd, loopStart, loopEnd;
 
     juce::AudioParameterInt* midiStart, * midiEnd, * midiRoot;
     juce::AudioParameterBool* followMidiPitch;
 
+    /** The loop crossfade, pre-rendered for looping voices (for each pyramid level). Rebuilt in the background when the bounds change. */
+    LoopSplice loopSplice;
+
     /** FX parameters */
-    juce::AudioParameterBool* reverbEnabled, * distortionEnabled, * eqEnabled, * chorusEnabled;
+    juce::AudioParameterBool* reverbEnabled, * distortionEnabled, * eqEnabled, * chorusEnabled, * sharedFX;
     juce::AudioParameterFloat* reverbMix, * reverbSize, * reverbDamping, * reverbLows, * reverbHighs, * reverbPredelay;
     juce::AudioParameterFloat* distortionMix, * distortionDensity, * distortionHighpass;
     juce::AudioParameterFloat* eqLowGain, * eqMidGain, * eqHighGain, * eqLowFreq, * eqHighFreq;
     juce::AudioParameterFloat* chorusMix, * chorusRate, * chorusDepth, * chorusFeedback, * chorusCenterDelay;
 
 private:
+    void valueChanged(ListenableValue<int>& source, int newValue) override;
+
+    PluginParameters::State& pluginState;
+    bool followingBounds{ true };
+
     juce::AudioParameterChoice* playbackMode;
     juce::AudioParameterInt* fxOrder;
+    std::atomic<bool> loaded{ true };
 };
\ No newline at end of file
@@ -12,7 +12,8 @@
 #include <Bungee.h>
 
 // Bungee sets a hard limit on the pitch ratio to simplify memory management. We can increase this limit before building
-// and use a resampling hack when necessary (the hack is not great because it requires reallocation of the stretcher).
+// and use a resampling hack when necessary: telling Bungee the input is at a lower sample rate lowers the pitch further.
+// The hack works in whole octaves, with a Bungee instance prepared ahead of time for each one that's needed.
 // This must be set to the value in Timing.cpp (internal to Bungee)
 static constexpr int bungeeMaxPitchOctaves = BUNGEE_MAX_OCTAVES;
 static constexpr float bungeeMinimumRatio = 1.f / (1 << bungeeMaxPitchOctaves);
@@ -23,123 +24,213 @@ public:
     explicit BungeeStretcher(const juce::AudioBuffer<float>& sampleBuffer, int sampleRate) : buffer(&sampleBuffer),
         bufferSampleRate(sampleRate)
     {
+        // Grains can be read straight from the sample if its channels are evenly spaced, which they are in an AudioBuffer that owns its data
+        const int numChannels = buffer->getNumChannels();
+        channelStride = numChannels > 1 ? buffer->getReadPointer(1) - buffer->getReadPointer(0) : 0;
+        planarInput = numChannels > 0;
+        for (int ch = 1; ch < numChannels; ch++)
+            planarInput = planarInput && buffer->getReadPointer(ch) - buffer->getReadPointer(0) == ch * channelStride;
     }
 
-    /** Allocates a new stretcher and the input buffer. */
-    void preallocateStretcher(int appSampleRate)
+    static constexpr int MAX_RESAMPLING_OCTAVES{ 12 };
+
+    /** Returns how many octaves of the resampling hack a pitch ratio needs */
+    static int getResamplingOctaves(float pitchRatio)
     {
-        if (appSampleRate == 0 || appSampleRate == applicationSampleRate)
-            return; 
+        int octaves = 0;
+        while (pitchRatio < bungeeMinimumRatio && octaves < MAX_RESAMPLING_OCTAVES)
+        {
+            pitchRatio *= 2.f;
+            octaves++;
+        }
+        return octaves;
+    }
 
-        bungee = std::make_unique<Bungee::Stretcher<Bungee::Basic>>(Bungee::SampleRates{ bufferSampleRate, appSampleRate }, buffer->getNumChannels());
-        inputData.setSize(1, buffer->getNumChannels() * bungee->maxInputFrameCount(), false, false, true);  // Note, maxInputFrameCount has a reported overflow issue
-        previousInputRate = bufferSampleRate;
+    /** Allocates the Bungee instances (and their input buffers) for the application sample rate, with resamplingOctaves octaves
+        of the resampling hack. This isn't real-time safe, but more octaves can be added while the stretcher is in use.
+    */
+    void preallocateStretcher(int appSampleRate, int resamplingOctaves = 0)
+    {
+        if (appSampleRate == 0 || (applicationSampleRate != 0 && appSampleRate != applicationSampleRate))
+            return;
         applicationSampleRate = appSampleRate;
+
+        resamplingOctaves = juce::jlimit(0, MAX_RESAMPLING_OCTAVES, resamplingOctaves);
+        for (int i = numPreparedOctaves.load(std::memory_order_relaxed); i <= resamplingOctaves; i++)
+        {
+            auto& instance = instances[size_t(i)];
+            instance.bungee = std::make_unique<Bungee::Stretcher<Bungee::Basic>>(Bungee::SampleRates{ bufferSampleRate >> i, appSampleRate }, buffer->getNumChannels());
+            // maxInputFrameCount has a reported overflow issue, so there's some headroom
+            instance.inputData.setSize(1, 2 * buffer->getNumChannels() * instance.bungee->maxInputFrameCount(), false, false, true);
+            numPreparedOctaves.store(i + 1, std::memory_order_release);
+        }
     }
 
+    /** Moves the stretcher to a new position. If it was prerolled with beginPreroll() close enough to the position (and for the
+        same octave), this only finishes that preroll, otherwise it prerolls from scratch, which takes a number of grains at once.
+    */
     void initialize(long double sampleStart, float initialRatio = 1, float initialSpeed = 1)
     {
-        setPitchAndSpeed(initialRatio, initialSpeed);
-
-        // We only reallocate when necessary (if resamplingHack requires it, as it's not good for real-time performance)
-        int inputRate = int(bufferSampleRate / resamplingHack);
-        if (inputRate != previousInputRate)
+        const double position = double(sampleStart);
+        if (prerollState != PrerollState::NONE && getOctave(initialRatio) == octave)
         {
-            bungee = std::make_unique<Bungee::Stretcher<Bungee::Basic>>(Bungee::SampleRates{ inputRate, applicationSampleRate }, buffer->getNumChannels());
-            inputData.setSize(1, buffer->getNumChannels() * bungee->maxInputFrameCount(), false, false, true);  // maxInputFrameCount has a reported overflow issue
-            previousInputRate = inputRate;
+            setPitchAndSpeed(initialRatio, initialSpeed);
+            continuePreroll(std::numeric_limits<int>::max());
+            if (isInOutput(position))
+            {
+                outputIndex = getOutputIndex(position);
+                prerollState = PrerollState::NONE;
+                return;
+            }
         }
 
+        beginPreroll(position, initialRatio, initialSpeed);
+        continuePreroll(std::numeric_limits<int>::max());
+        prerollState = PrerollState::NONE;
+    }
+
+    /** Starts prerolling to a position that initialize() will probably be called with later. The grains are processed by
+        continuePreroll(), which lets the work be spread over several blocks.
+    */
+    void beginPreroll(double position, float initialRatio, float initialSpeed)
+    {
+        octave = getOctave(initialRatio);
+        bungee = instances[size_t(octave)].bungee.get();
+        inputData = &instances[size_t(octave)].inputData;
+        setPitchAndSpeed(initialRatio, initialSpeed);
+
         output = Bungee::OutputChunk{};
         outputIndex = 0;
 
-        preroll(double(sampleStart));
+        prerollPosition = position;
+        prerollState = PrerollState::RUNNING;
+        request = Bungee::Request{ position, speedFactor * resamplingHack, pitchRatio, true };
+        bungee->preroll(request);
     }
 
-    /** Pre-rolls the stretcher to a new position. Use this before you plan to move the position. */
-    void preroll(double newPosition)
+    /** Processes at most maxGrains grains of the preroll, returns true once the stretcher's output has reached the position */
+    bool continuePreroll(int maxGrains)
     {
-        request = Bungee::Request{ newPosition, speedFactor * resamplingHack, pitchRatio, true };
-        bungee->preroll(request);
-
-        while (!output.data || std::isnan(output.request[Bungee::OutputChunk::begin]->position) || 
-            newPosition > output.request[Bungee::OutputChunk::end]->position || newPosition < output.request[Bungee::OutputChunk::begin]->position)
+        for (int grains = 0; prerollState == PrerollState::RUNNING && grains < maxGrains; grains++)
         {
             auto input = bungee->specifyGrain(request);
 
-            if (buffer->getNumChannels() * (input.end - input.begin) >= inputData.getNumSamples())  // Can happen with extreme ratios
-                inputData.setSize(1, buffer->getNumChannels() * (input.end - input.begin));
+            // Nothing before the new position is heard, which can be before the sample (e.g. a loop preroll from sampleStart - 1)
+            analyseGrain(input, juce::jmax(0, int(std::ceil(prerollPosition))));
+            bungee->synthesiseGrain(output);
+            bungee->next(request);
+
+            if (isInOutput(prerollPosition))
+            {
+                outputIndex = getOutputIndex(prerollPosition);
+                prerollState = PrerollState::DONE;
+            }
+        }
+
+        return prerollState == PrerollState::DONE;
+    }
 
-            int begin = juce::jlimit<int>(int(std::ceil(newPosition)), buffer->getNumSamples(), input.begin);
-            int end = juce::jlimit<int>(int(std::ceil(newPosition)), buffer->getNumSamples(), input.end);
+    /** Forgets a preroll, for when the stretcher is about to be used for something else */
+    void cancelPreroll() { prerollState = PrerollState::NONE; }
 
-            inputData.clear();
-            if (begin < end)
+    /** Writes the next numSamples of every channel to out, starting at startSample */
+    void nextBlock(float* const* out, int startSample, int numSamples)
+    {
+        while (numSamples > 0)
+        {
+            if (outputIndex >= output.frameCount)
             {
-                for (int ch = 0; ch < buffer->getNumChannels(); ch++)
-                    inputData.copyFrom(0, ch * (input.end - input.begin) + begin - input.begin, *buffer, ch, begin, end - begin);
+                request.pitch = pitchRatio;
+                request.speed = speedFactor * resamplingHack;
+                analyseGrain(bungee->specifyGrain(request), 0);
+                bungee->synthesiseGrain(output);
+                bungee->next(request);
+
+                outputIndex = 0;
+                continue;
             }
 
-            bungee->analyseGrain(inputData.getReadPointer(0), (input.end - input.begin));
-            bungee->synthesiseGrain(output);
-            bungee->next(request);
+            const int count = juce::jmin(numSamples, output.frameCount - outputIndex);
+            for (int ch = 0; ch < buffer->getNumChannels(); ch++)
+                juce::FloatVectorOperations::copy(out[ch] + startSample, output.data + ch * output.channelStride + outputIndex, count);
 
-            outputIndex = int(std::round((newPosition - output.request[Bungee::OutputChunk::begin]->position) / positionSpeed));
+            outputIndex += count;
+            startSample += count;
+            numSamples -= count;
         }
     }
 
-    /** Fetches the next sample. Call this for each channel before advancing. */
-    float nextSample(int channel, bool advance = true)
+    void setPitchAndSpeed(float newPitchRatio, float newSpeedFactor)
     {
-        if (outputIndex >= output.frameCount)
-        {
-            request.pitch = pitchRatio;
-            request.speed = speedFactor * resamplingHack;
-            auto [begin, end] = bungee->specifyGrain(request);
+        // The octave stays the same until the next initialize(), so Bungee's limits apply around it
+        resamplingHack = float(1 << octave);
+        pitchRatio = juce::jlimit(bungeeMinimumRatio, 1.f / bungeeMinimumRatio, newPitchRatio * resamplingHack);
+        speedFactor = newSpeedFactor;
 
-            begin = juce::jlimit<int>(0, buffer->getNumSamples(), begin);
-            end = juce::jlimit<int>(0, buffer->getNumSamples(), end);
+        positionSpeed = speedFactor * bufferSampleRate / applicationSampleRate;
+    }
 
-            inputData.clear();  // Preferring simplicity over maximum efficiency
-            for (int ch = 0; ch < buffer->getNumChannels(); ch++)
-                inputData.copyFrom(0, ch * (end - begin), *buffer, ch, begin, end - begin);
+    /** Returns the speed at which the stretcher advances through the buffer, relative to the buffer's sample rate. */
+    float getPositionSpeed() const { return positionSpeed; }
 
-            bungee->analyseGrain(inputData.getReadPointer(0), end - begin);
-            bungee->synthesiseGrain(output);
-            bungee->next(request);
+private:
+    enum class PrerollState
+    {
+        NONE,
+        RUNNING,
+        DONE
+    };
 
-            outputIndex = 0;
-        }
+    /** The octave of the resampling hack for a pitch ratio, if it wasn't prepared (yet), the pitch is as low as it can go */
+    int getOctave(float ratio) const
+    {
+        jassert(numPreparedOctaves.load(std::memory_order_relaxed) > 0);
+        return juce::jlimit(0, numPreparedOctaves.load(std::memory_order_acquire) - 1, getResamplingOctaves(ratio));
+    }
 
-        float result = output.data[channel * output.channelStride + outputIndex];
-        if (advance)
-            outputIndex++;
+    bool isInOutput(double position) const
+    {
+        return output.data && !std::isnan(output.request[Bungee::OutputChunk::begin]->position) &&
+            position <= output.request[Bungee::OutputChunk::end]->position && position >= output.request[Bungee::OutputChunk::begin]->position;
+    }
 
-        return result;
+    int getOutputIndex(double position) const
+    {
+        return int(std::round((position - output.request[Bungee::OutputChunk::begin]->position) / positionSpeed));
     }
 
-    void setPitchAndSpeed(float newPitchRatio, float newSpeedFactor)
+    /** Feeds a grain to Bungee. If it lies within the sample (from firstSample on), Bungee reads it in place, otherwise the
+        part that's outside is zero-padded in inputData.
+    */
+    void analyseGrain(Bungee::InputChunk input, int firstSample)
     {
-        pitchRatio = newPitchRatio;
-        speedFactor = newSpeedFactor;
+        jassert(firstSample >= 0);
+        const int length = input.end - input.begin;
+        if (planarInput && input.begin >= firstSample && input.end <= buffer->getNumSamples())
+        {
+            bungee->analyseGrain(buffer->getReadPointer(0) + input.begin, channelStride);
+            return;
+        }
 
-        if (newPitchRatio < bungeeMinimumRatio)
+        if (buffer->getNumChannels() * length > inputData->getNumSamples())
         {
-            pitchRatio = bungeeMinimumRatio;
-            resamplingHack = bungeeMinimumRatio / newPitchRatio;
+            jassertfalse;  // The headroom should prevent this, but allocating is better than overrunning the buffer
+            inputData->setSize(1, buffer->getNumChannels() * length);
         }
-        else
+
+        const int begin = juce::jlimit<int>(firstSample, buffer->getNumSamples(), input.begin);
+        const int end = juce::jlimit<int>(firstSample, buffer->getNumSamples(), input.end);
+
+        inputData->clear(0, 0, buffer->getNumChannels() * length);
+        if (begin < end)
         {
-            resamplingHack = 1.f;
+            for (int ch = 0; ch < buffer->getNumChannels(); ch++)
+                inputData->copyFrom(0, ch * length + begin - input.begin, *buffer, ch, begin, end - begin);
         }
-        
-        positionSpeed = speedFactor * bufferSampleRate / applicationSampleRate;
-    }
 
-    /** Returns the speed at which the stretcher advances through the buffer, relative to the buffer's sample rate. */
-    float getPositionSpeed() const { return positionSpeed; }
+        bungee->analyseGrain(inputData->getReadPointer(0), length);
+    }
 
-private:
     const juce::AudioBuffer<float>* buffer{ nullptr };
     int bufferSampleRate{ 0 };
     int applicationSampleRate{ 0 };
@@ -150,12 +241,26 @@ private:
 
     // We use a little hack to ignore Bungee's maxPitchOctaves limit
     float resamplingHack{ 1.f };
-    int previousInputRate{ 0 };
+    int octave{ 0 };
 
-    std::unique_ptr<Bungee::Stretcher<Bungee::Basic>> bungee;
+    /** A Bungee instance for each octave of the resampling hack, the input is at bufferSampleRate >> octave */
+    struct Instance
+    {
+        std::unique_ptr<Bungee::Stretcher<Bungee::Basic>> bungee;
+        juce::AudioBuffer<float> inputData;  // Only used for grains that reach outside the sample
+    };
+    std::array<Instance, MAX_RESAMPLING_OCTAVES + 1> instances;
+    std::atomic<int> numPreparedOctaves{ 0 };  // Published with release ordering, so they can be added while the stretcher plays
+
+    Bungee::Stretcher<Bungee::Basic>* bungee{ nullptr };
+    juce::AudioBuffer<float>* inputData{ nullptr };
     Bungee::Request request{};
     Bungee::OutputChunk output{};
 
-    juce::AudioBuffer<float> inputData;
+    intptr_t channelStride{ 0 };
+    bool planarInput{ false };
     int outputIndex{ 0 };
+
+    PrerollState prerollState{ PrerollState::NONE };
+    double prerollPosition{ 0. };
 };
@@ -0,0 +1,347 @@
+/*
+  ==============================================================================
+
+    StretcherPool.h
+    Created: 16 Oct 2026 7:48:05pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#include "SamplerParameters.h"
+#include "Stretcher.h"
+#include <libMTSClient.h>
+
+/** The Bungee stretchers of a loaded sample, shared by its voices. A voice in BUNGEE mode checks out the stretchers it needs
+    when a note starts, and returns them when it stops.
+
+    Stretchers are only prepared on the message thread, with reserve(), as many as the voices in use can need at once (see
+    getRequiredSize()). Checking out and returning are lock-free, so they're safe from the audio thread and the render workers.
+    If the pool has run dry (because BUNGEE mode or looping was only just turned on), checkout() returns nullptr.
+
+    Each stretcher is also prepared for the octaves of Bungee's resampling hack that the lowest playable note needs (see
+    getRequiredOctaves()), so even extremely low notes don't allocate.
+
+    Starting a note has to preroll its stretcher, which takes several grains. To keep that out of the audio thread (where a chord
+    would preroll them all in one block), a background thread keeps up to WARM_STRETCHERS idle stretchers prerolled at the start
+    of the sample, for the notes that were played most recently (or for every note, when the pitch doesn't follow MIDI). A voice
+    that finds a warm stretcher for its note with checkoutWarm() only has to pick up where the preroll left off.
+*/
+class StretcherPool final : private juce::Thread
+{
+public:
+    static constexpr int MAX_STRETCHERS{ 3 * PluginParameters::MAX_VOICES + 1 };  // A main, loop, and end stretcher for every voice, and the warmer's
+    static constexpr int WARM_STRETCHERS{ 8 };
+    static constexpr int POLL_INTERVAL{ 50 };  // In milliseconds
+
+    /** Where a stretcher was prerolled to, and for which pitch and speed */
+    struct WarmTarget
+    {
+        double position{ -1. };
+        float pitch{ 0.f };
+        float speed{ 0.f };
+
+        bool operator==(const WarmTarget& other) const = default;
+    };
+
+    StretcherPool(const SamplerParameters& sampleSound, MTSClient* mtsClient) : Thread("Stretcher_Warmer"),
+        sampleSound(sampleSound), mtsClient(mtsClient)
+    {
+    }
+
+    ~StretcherPool() override
+    {
+        stopThread(1000);
+    }
+
+    /** The number of stretchers that numVoices voices can have checked out at once with the current parameters, and one
+        for the background thread to warm up.
+    */
+    static int getRequiredSize(const SamplerParameters& sampleSound, int numVoices)
+    {
+        if (sampleSound.getPlaybackMode() != PluginParameters::BUNGEE || sampleSound.sample.getNumChannels() == 0)
+            return 0;
+
+        const bool isLooping = sampleSound.isLooping->get();
+        const bool loopingHasEnd = isLooping && sampleSound.loopingHasEnd->get();
+        return numVoices * (1 + int(isLooping) + int(loopingHasEnd)) + 1;
+    }
+
+    /** The octaves of the resampling hack that the lowest playable note can need, with the current parameters */
+    static int getRequiredOctaves(const SamplerParameters& sampleSound, MTSClient* mtsClient)
+    {
+        // This mirrors SamplerParameters::getTuning, with the pitch wheel all the way down
+        float semitones = float(sampleSound.semitoneTuning->get()) + float(sampleSound.centTuning->get()) / 100.f;
+        semitones += sampleSound.wideTuningControl->get() - sampleSound.pitchWheelRange->get();
+
+        float tuningRatio = 1.f;
+        if (sampleSound.followMidiPitch->get())
+        {
+            semitones += float(sampleSound.midiStart->get() - sampleSound.midiRoot->get());
+            for (int note = sampleSound.midiStart->get(); note <= sampleSound.midiEnd->get(); note++)
+                tuningRatio = juce::jmin(tuningRatio, float(MTS_RetuningAsRatio(mtsClient, char(note), -1)));
+        }
+
+        return BungeeStretcher::getResamplingOctaves(tuningRatio * std::exp2(semitones / 12.f));
+    }
+
+    /** Sets the application sample rate the stretchers are prepared for. If it changed, the stretchers are dropped and every
+        slot is freed, so this must only be called when no voice has any checked out.
+    */
+    void prepare(int newApplicationSampleRate)
+    {
+        if (newApplicationSampleRate == applicationSampleRate)
+            return;
+
+        stopThread(1000);
+        for (auto& slot : slots)
+        {
+            slot.stretcher.reset();
+            slot.warm.store(false, std::memory_order_relaxed);
+            slot.inUse.store(false, std::memory_order_relaxed);
+        }
+        numPrepared.store(0, std::memory_order_release);
+        resamplingOctaves = 0;
+        applicationSampleRate = newApplicationSampleRate;
+    }
+
+    /** Prepares stretchers until there are at least numStretchers, each with at least numOctaves octaves of the resampling hack.
+        This isn't real-time safe, but the stretchers that are checked out only gain octaves they weren't using.
+    */
+    void reserve(int numStretchers, int numOctaves)
+    {
+        numStretchers = juce::jmin(numStretchers, MAX_STRETCHERS);
+        if (applicationSampleRate <= 0 || numStretchers <= 0)
+            return;
+
+        if (numOctaves > resamplingOctaves)
+        {
+            resamplingOctaves = numOctaves;
+            for (int i = 0; i < numPrepared.load(std::memory_order_relaxed); i++)
+                slots[size_t(i)].stretcher->preallocateStretcher(applicationSampleRate, resamplingOctaves);
+        }
+
+        for (int i = numPrepared.load(std::memory_order_relaxed); i < numStretchers; i++)
+        {
+            slots[size_t(i)].stretcher = std::make_unique<BungeeStretcher>(sampleSound.sample, sampleSound.sampleRate);
+            slots[size_t(i)].stretcher->preallocateStretcher(applicationSampleRate, resamplingOctaves);
+            numPrepared.store(i + 1, std::memory_order_release);
+        }
+
+        if (!isThreadRunning())
+            startThread(juce::Thread::Priority::low);
+    }
+
+    /** Lets the background thread know which notes to keep warm, this is real-time safe */
+    void notePlayed(int midiNote)
+    {
+        if (midiNote >= 0 && midiNote < 128)
+            lastPlayed[size_t(midiNote)].store(playCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /** Takes a stretcher that was prerolled for the target, or any free stretcher (not prerolled), or returns nullptr if there are none */
+    BungeeStretcher* checkoutWarm(const WarmTarget& target)
+    {
+        const int count = numPrepared.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++)
+        {
+            if (!slots[size_t(i)].warm.load(std::memory_order_relaxed) || !claim(i))
+                continue;
+
+            // While a slot is claimed, only its owner touches it
+            if (slots[size_t(i)].warm.load(std::memory_order_relaxed) && slots[size_t(i)].target == target)
+            {
+                slots[size_t(i)].warm.store(false, std::memory_order_relaxed);
+                return slots[size_t(i)].stretcher.get();
+            }
+            slots[size_t(i)].inUse.store(false, std::memory_order_release);
+        }
+        return checkout();
+    }
+
+    /** Takes a free stretcher (preferring ones that aren't warm), or returns nullptr if there are none */
+    BungeeStretcher* checkout()
+    {
+        const int count = numPrepared.load(std::memory_order_acquire);
+        for (bool takeWarm : { false, true })
+        {
+            for (int i = 0; i < count; i++)
+            {
+                if (slots[size_t(i)].warm.load(std::memory_order_relaxed) != takeWarm || !claim(i))
+                    continue;
+
+                slots[size_t(i)].warm.store(false, std::memory_order_relaxed);
+                slots[size_t(i)].stretcher->cancelPreroll();
+                return slots[size_t(i)].stretcher.get();
+            }
+        }
+        return nullptr;
+    }
+
+    /** Returns a stretcher that was checked out, nullptr is ignored */
+    void release(BungeeStretcher* stretcher)
+    {
+        if (!stretcher)
+            return;
+
+        const int count = numPrepared.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++)
+        {
+            if (slots[size_t(i)].stretcher.get() == stretcher)
+            {
+                slots[size_t(i)].inUse.store(false, std::memory_order_release);
+                return;
+            }
+        }
+        jassertfalse;
+    }
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<BungeeStretcher> stretcher;
+        std::atomic<bool> inUse{ false };
+        std::atomic<bool> warm{ false };  // Only changed while claimed, so voices can skip cold slots without claiming them
+        WarmTarget target;  // Only accessed while claimed
+    };
+
+    bool claim(int i)
+    {
+        bool expected = false;
+        return !slots[size_t(i)].inUse.load(std::memory_order_relaxed) && slots[size_t(i)].inUse.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            if (sampleSound.getPlaybackMode() == PluginParameters::BUNGEE)
+                warm();
+            wait(POLL_INTERVAL);
+        }
+    }
+
+    /** Prerolls stretchers for the targets that don't have one yet, letting go of the warm stretchers that aren't needed anymore */
+    void warm()
+    {
+        std::array<WarmTarget, WARM_STRETCHERS> targets{};
+        const int numTargets = getWarmTargets(targets);
+        std::array<bool, WARM_STRETCHERS> satisfied{};
+
+        const int count = numPrepared.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++)
+        {
+            if (!slots[size_t(i)].warm.load(std::memory_order_relaxed) || !claim(i))
+                continue;
+
+            bool needed = false;
+            for (int t = 0; t < numTargets && !needed; t++)
+            {
+                if (!satisfied[size_t(t)] && slots[size_t(i)].target == targets[size_t(t)])
+                    needed = satisfied[size_t(t)] = true;
+            }
+            slots[size_t(i)].warm.store(needed, std::memory_order_relaxed);
+            slots[size_t(i)].inUse.store(false, std::memory_order_release);
+        }
+
+        for (int t = 0; t < numTargets; t++)
+        {
+            if (satisfied[size_t(t)])
+                continue;
+
+            // Leave a free stretcher for the voices, this one gets prerolled for a while
+            int numFree = 0;
+            for (int i = 0; i < count; i++)
+                numFree += !slots[size_t(i)].inUse.load(std::memory_order_relaxed) && !slots[size_t(i)].warm.load(std::memory_order_relaxed);
+
+            for (int i = 0; i < count && numFree > 1; i++)
+            {
+                if (slots[size_t(i)].warm.load(std::memory_order_relaxed) || !claim(i))
+                    continue;
+
+                const auto& target = targets[size_t(t)];
+                slots[size_t(i)].target = target;
+                slots[size_t(i)].stretcher->beginPreroll(target.position, target.pitch, target.speed);
+                slots[size_t(i)].stretcher->continuePreroll(std::numeric_limits<int>::max());
+                slots[size_t(i)].warm.store(true, std::memory_order_relaxed);
+                slots[size_t(i)].inUse.store(false, std::memory_order_release);
+                break;
+            }
+
+            if (threadShouldExit())
+                return;
+        }
+    }
+
+    /** Where voices would start their notes right now, for the most recently played notes. Without the pitch following MIDI, every
+        note starts the same way.
+    */
+    int getWarmTargets(std::array<WarmTarget, WARM_STRETCHERS>& targets) const
+    {
+        const int sampleStart = sampleSound.sampleStart.load();
+        const int loopStart = sampleSound.loopStart.load();
+        const bool loopingHasStart = sampleSound.isLooping->get() && sampleSound.loopingHasStart->get() && loopStart < sampleStart;
+
+        WarmTarget target;
+        target.position = loopingHasStart ? loopStart : sampleStart;
+
+        // The pitch wheel is assumed to be centered
+        auto makeTarget = [&](int note)
+            {
+                const auto tuning = sampleSound.getTuning(note, 8192, mtsClient);
+                target.pitch = tuning.pitch;
+                target.speed = tuning.speed;
+                return target;
+            };
+
+        const int midiStart = sampleSound.midiStart->get();
+        const int midiEnd = sampleSound.midiEnd->get();
+        if (!sampleSound.followMidiPitch->get())
+        {
+            targets.fill(makeTarget(midiStart));
+            return WARM_STRETCHERS;
+        }
+
+        std::array<uint32_t, WARM_STRETCHERS> played{};
+        int numTargets = 0;
+        for (int note = midiStart; note <= midiEnd; note++)
+        {
+            const uint32_t when = lastPlayed[size_t(note)].load(std::memory_order_relaxed);
+            if (when == 0)
+                continue;
+
+            // Insertion sort, most recent first
+            int t = juce::jmin(numTargets, WARM_STRETCHERS - 1);
+            if (numTargets == WARM_STRETCHERS && when <= played[size_t(t)])
+                continue;
+            for (; t > 0 && played[size_t(t - 1)] < when; t--)
+            {
+                played[size_t(t)] = played[size_t(t - 1)];
+                targets[size_t(t)] = targets[size_t(t - 1)];
+            }
+            played[size_t(t)] = when;
+            targets[size_t(t)] = makeTarget(note);
+            numTargets = juce::jmin(numTargets + 1, WARM_STRETCHERS);
+        }
+
+        if (numTargets == 0)
+            targets[size_t(numTargets++)] = makeTarget(juce::jlimit(midiStart, midiEnd, sampleSound.midiRoot->get()));
+        return numTargets;
+    }
+
+    const SamplerParameters& sampleSound;
+    MTSClient* mtsClient;
+    int applicationSampleRate{ 0 };
+    int resamplingOctaves{ 0 };  // What the prepared stretchers have, only used on the message thread
+
+    std::array<Slot, MAX_STRETCHERS> slots;
+    std::atomic<int> numPrepared{ 0 };  // Slots below this have a stretcher, which are published with release ordering
+
+    std::array<std::atomic<uint32_t>, 128> lastPlayed{};  // When each note was last played, by playCounter (0 is never)
+    std::atomic<uint32_t> playCounter{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StretcherPool)
+};
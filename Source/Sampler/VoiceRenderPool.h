@@ -0,0 +1,295 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.h
+    Created: 16 Oct 2026 6:12:44pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+/** The realtime worker threads that render voices for every VoiceRenderPool in the process, shared through a
+    juce::SharedResourcePointer. There's one for each spare physical core, up to MAX_WORKERS, no matter how many instances are
+    loaded. When woken, a worker runs the jobs of every registered source until none are left.
+*/
+class VoiceRenderWorkers final
+{
+public:
+    /** Something with jobs for the workers to run, i.e. a VoiceRenderPool */
+    struct JobSource
+    {
+        virtual ~JobSource() = default;
+        virtual void runJobs() = 0;
+    };
+
+    static constexpr int MAX_WORKERS{ 8 };
+    static constexpr int MAX_SOURCES{ 32 };  // Any more sources do without the workers
+
+    VoiceRenderWorkers()
+    {
+        const int numWorkers = juce::jlimit(0, MAX_WORKERS, juce::SystemStats::getNumPhysicalCpus() - 1);
+        for (int i = 0; i < numWorkers; i++)
+            workers.add(new Worker(*this, i));
+
+        for (auto* worker : workers)
+            if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}))
+                worker->startThread(juce::Thread::Priority::highest);
+    }
+
+    ~VoiceRenderWorkers()
+    {
+        for (auto* worker : workers)
+            worker->signalThreadShouldExit();
+        for (auto* worker : workers)
+        {
+            worker->notify();
+            worker->stopThread(-1);
+        }
+    }
+
+    int getNumWorkers() const { return workers.size(); }
+
+    /** Returns false if there's no room for another source */
+    bool add(JobSource& source)
+    {
+        const juce::ScopedLock lock(sourcesLock);
+        for (auto& slot : sources)
+        {
+            if (slot.load() == nullptr)
+            {
+                slot.store(&source);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Once this returns, no worker is running the source's jobs, or can start to */
+    void remove(JobSource& source)
+    {
+        const juce::ScopedLock lock(sourcesLock);
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            if (sources[i].load() == &source)
+            {
+                sources[i].store(nullptr);
+                while (visitors[i].load() > 0)
+                    juce::Thread::yield();
+            }
+        }
+    }
+
+    /** Wakes up to numWorkers workers, this can be called from the audio thread */
+    void wake(int numWorkers)
+    {
+        for (int i = 0; i < juce::jmin(numWorkers, workers.size()); i++)
+            workers.getUnchecked(i)->notify();
+    }
+
+private:
+    class Worker final : public juce::Thread
+    {
+    public:
+        Worker(VoiceRenderWorkers& owner, int index) : Thread("Voice_Render_" + juce::String(index)), owner(owner) {}
+
+        void run() override
+        {
+            while (!threadShouldExit())
+            {
+                wait(-1);
+                owner.runJobs();
+            }
+        }
+
+    private:
+        VoiceRenderWorkers& owner;
+    };
+
+    /** A source is only visited while its visitor count is raised, which is how remove() knows when it's safe to return */
+    void runJobs()
+    {
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            visitors[i].fetch_add(1);
+            if (auto* source = sources[i].load())
+                source->runJobs();
+            visitors[i].fetch_sub(1);
+        }
+    }
+
+    juce::OwnedArray<Worker> workers;
+    std::array<std::atomic<JobSource*>, MAX_SOURCES> sources{};
+    std::array<std::atomic<int>, MAX_SOURCES> visitors{};
+    juce::CriticalSection sourcesLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceRenderWorkers)
+};
+
+/** Renders the active voices of a synth's blocks in parallel, on the shared VoiceRenderWorkers and the audio thread itself.
+
+    Every active voice is a job, which renders into a buffer of its own. Jobs are claimed one at a time from a shared counter,
+    so a thread that finishes early takes the next voice instead of waiting on a fixed share (voices can differ a lot in cost,
+    e.g. with BUNGEE or FX). Once every job is done, the buffers are summed into the output in voice order, so the result is the
+    same as rendering the voices one after another, no matter which thread rendered what.
+
+    The audio thread never sits idle waiting for the workers to wake up, it takes jobs like any of them, so when the workers are
+    busy with other instances it just renders more of the voices itself. It only has to wait for voices that a worker is already
+    rendering, which can't be abandoned halfway. It spins for up to TIMEOUT of the block, and past that the workers are probably
+    being starved, so it sleeps until they're done rather than compete with them for the core, and the pool is bypassed (voices
+    render inline) for the next BYPASS_BLOCKS blocks.
+*/
+class VoiceRenderPool final : private VoiceRenderWorkers::JobSource
+{
+public:
+    static constexpr int MIN_PARALLEL_VOICES{ 2 };  // With fewer active voices, waking the workers costs more than it saves
+    static constexpr double TIMEOUT{ 0.25 };  // As a fraction of the block's duration
+    static constexpr int BYPASS_BLOCKS{ 64 };
+
+    VoiceRenderPool()
+    {
+        registered = workers->getNumWorkers() > 0 && workers->add(*this);
+    }
+
+    ~VoiceRenderPool() override
+    {
+        if (registered)
+            workers->remove(*this);
+    }
+
+    /** Allocates the voice buffers, this must not be called while rendering */
+    void prepare(double sampleRate, int blockSize, int numChannels, int maxVoices)
+    {
+        maxBlockSize = blockSize;
+        timeoutMs = 1000. * TIMEOUT * blockSize / sampleRate;
+        bypassBlocks = 0;
+
+        buffers.resize(size_t(maxVoices));
+        for (auto& buffer : buffers)
+            buffer.setSize(numChannels, blockSize);
+        jobs.resize(size_t(maxVoices));
+    }
+
+    /** Renders the voices into the output, returns false without rendering anything if they should be rendered inline instead */
+    bool render(const juce::OwnedArray<juce::SynthesiserVoice>& voices, juce::AudioBuffer<float>& output, int startSample, int numSamples)
+    {
+        if (!registered)
+            return false;
+
+        if (bypassBlocks > 0)
+        {
+            bypassBlocks--;
+            return false;
+        }
+
+        if (numSamples > maxBlockSize || buffers.empty() || output.getNumChannels() != buffers[0].getNumChannels())
+            return false;
+
+        int numActive = 0;
+        for (auto* voice : voices)
+            numActive += voice->isVoiceActive();
+        if (numActive < MIN_PARALLEL_VOICES || numActive > int(jobs.size()))
+            return false;
+
+        // Inactive voices only need to notice that they've stopped, which is cheaper done here
+        int count = 0;
+        for (auto* voice : voices)
+        {
+            if (voice->isVoiceActive())
+            {
+                jobs[size_t(count)] = { voice, &buffers[size_t(count)] };
+                count++;
+            }
+            else
+            {
+                voice->renderNextBlock(output, startSample, numSamples);
+            }
+        }
+
+        jobSamples = numSamples;
+        finishedJobs.store(0, std::memory_order_relaxed);
+        nextJob.store(uint64_t(count) << 32, std::memory_order_release);
+
+        workers->wake(count - 1);
+        claimJobs();
+
+        if (finishedJobs.load(std::memory_order_acquire) < count)
+        {
+            // The remaining voices are already being rendered, so all we can do is wait for them
+            const double deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+            while (finishedJobs.load(std::memory_order_acquire) < count && juce::Time::getMillisecondCounterHiRes() < deadline)
+            {
+            }
+
+            if (finishedJobs.load(std::memory_order_acquire) < count)
+            {
+                bypassBlocks = BYPASS_BLOCKS;
+                while (finishedJobs.load(std::memory_order_acquire) < count)
+                    jobsFinished.wait(1);
+            }
+        }
+
+        for (int i = 0; i < count; i++)
+            for (int ch = 0; ch < output.getNumChannels(); ch++)
+                output.addFrom(ch, startSample, buffers[size_t(i)], ch, 0, numSamples);
+
+        return true;
+    }
+
+private:
+    struct Job
+    {
+        juce::SynthesiserVoice* voice{ nullptr };
+        juce::AudioBuffer<float>* buffer{ nullptr };
+    };
+
+    /** Called by the workers, the one that finishes the last job wakes the audio thread in case it's sleeping */
+    void runJobs() override
+    {
+        if (claimJobs())
+            jobsFinished.signal();
+    }
+
+    /** Claims and renders jobs until there are none left, returns true if the last job to finish was one of them. The counter
+        holds the number of jobs in its upper half and the next job in the lower half, and it's only advanced while there are jobs
+        left, so a thread that arrives late (after the block is over) normally finds none. If it loaded the counter during one
+        block and only gets to swap it during a later one that has reached the same value (ABA), it does claim a job of that
+        block. That's harmless: it reads the job after claiming it, so it renders a job of the current block like any other.
+    */
+    bool claimJobs()
+    {
+        bool finishedLast = false;
+        uint64_t claim = nextJob.load(std::memory_order_acquire);
+        while (int(claim & 0xffffffff) < int(claim >> 32))
+        {
+            if (!nextJob.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                continue;
+
+            const auto& job = jobs[size_t(claim & 0xffffffff)];
+            job.buffer->clear(0, jobSamples);
+            job.voice->renderNextBlock(*job.buffer, 0, jobSamples);
+            finishedLast = finishedJobs.fetch_add(1, std::memory_order_acq_rel) + 1 == int(claim >> 32);
+            claim = nextJob.load(std::memory_order_acquire);
+        }
+        return finishedLast;
+    }
+
+    juce::SharedResourcePointer<VoiceRenderWorkers> workers;
+    bool registered{ false };
+
+    std::vector<juce::AudioBuffer<float>> buffers;
+    std::vector<Job> jobs;
+
+    int maxBlockSize{ 0 };
+    int jobSamples{ 0 };
+    double timeoutMs{ 0. };
+    int bypassBlocks{ 0 };
+
+    std::atomic<uint64_t> nextJob{ 0 };
+    std::atomic<int> finishedJobs{ 0 };
+    juce::WaitableEvent jobsFinished;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceRenderPool)
+};
@@ -60,6 +60,32 @@ inline void mixToBuffer(const juce::AudioBuffer<float>& src, juce::AudioBuffer<f
     }
 }
 
+/** Appends the buffer to the block as an audio file, FLAC if compressed (and FLAC supports the format) or WAV otherwise.
+    Returns whether it was compressed. If shouldStop returns true the buffer is left partially written.
+*/
+inline bool encodeBuffer(juce::MemoryBlock& dest, const juce::AudioBuffer<float>& buffer, double sampleRate, bool compressed, int bitsPerSample,
+    const std::function<bool()>& shouldStop = nullptr)
+{
+    juce::FlacAudioFormat flacFormat;
+    juce::WavAudioFormat wavFormat;
+    compressed = compressed && flacFormat.getPossibleSampleRates().contains(int(sampleRate)) && flacFormat.getPossibleBitDepths().contains(bitsPerSample);
+    juce::AudioFormat& format = compressed ? static_cast<juce::AudioFormat&>(flacFormat) : wavFormat;
+
+    auto options = juce::AudioFormatWriterOptions{}
+        .withSampleRate(sampleRate)
+        .withNumChannels(buffer.getNumChannels())
+        .withBitsPerSample(bitsPerSample);
+
+    std::unique_ptr<juce::OutputStream> stream = std::make_unique<juce::MemoryOutputStream>(dest, true);
+    if (auto formatWriter = format.createWriterFor(stream, options))
+    {
+        constexpr int blockSize = 1 << 16;
+        for (int start = 0; start < buffer.getNumSamples() && !(shouldStop && shouldStop()); start += blockSize)
+            formatWriter->writeFromAudioSampleBuffer(buffer, start, juce::jmin(blockSize, buffer.getNumSamples() - start));
+    }
+    return compressed;
+}
+
 /**
   Silences the buffer if bad or loud values are detected in the output buffer.
   Use this during debugging to avoid blowing out your eardrums on headphones.
@@ -115,17 +141,3 @@ inline void protectYourEars(float* buffer, int sampleCount)
         }
     }
 }
-
-/** Uses MD-5 hashing to generate an identifier for the AudioBuffer */
-inline juce::String getSampleHash(const juce::AudioBuffer<float>& buffer)
-{
-    juce::MemoryBlock memoryBlock;
-
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
-    {
-        memoryBlock.append(buffer.getReadPointer(channel), buffer.getNumSamples() * sizeof(float));
-    }
-
-    juce::MD5 md5{ memoryBlock };
-    return md5.toHexString();
-}
\ No newline at end of file
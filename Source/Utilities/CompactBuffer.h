@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    CompactBuffer.h
+    Created: 17 Oct 2026 12:34:18am
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+/** Audio stored as 16-bit integers, half the size of a juce::AudioBuffer<float>. Each channel is scaled so that its peak uses
+    the full range, so quiet material keeps its resolution and nothing clips. Samples are read as getReadPointer(ch)[i] *
+    getGain(ch), and Lanczos::interpolateChannel() converts them as it reads.
+
+    Channels are written whole, with copyFrom(), since the gain depends on all of the channel.
+*/
+class CompactBuffer final
+{
+public:
+    void setSize(int newNumChannels, int newNumSamples)
+    {
+        numChannels = newNumChannels;
+        numSamples = newNumSamples;
+        data.assign(size_t(numChannels) * size_t(numSamples), 0);
+        gains.assign(size_t(numChannels), 1.f);
+    }
+
+    int getNumChannels() const { return numChannels; }
+    int getNumSamples() const { return numSamples; }
+
+    const int16_t* getReadPointer(int channel, int sampleIndex = 0) const
+    {
+        jassert(juce::isPositiveAndBelow(channel, numChannels));
+        return data.data() + size_t(channel) * size_t(numSamples) + size_t(sampleIndex);
+    }
+
+    float getGain(int channel) const { return gains[size_t(channel)]; }
+    float getSample(int channel, int sampleIndex) const { return getReadPointer(channel)[sampleIndex] * getGain(channel); }
+
+    /** Quantizes a whole channel, matching juce::AudioBuffer<float>::copyFrom() */
+    void copyFrom(int destChannel, int destStartSample, const float* source, int numSamplesToCopy)
+    {
+        jassert(destStartSample == 0 && numSamplesToCopy == numSamples);
+        juce::ignoreUnused(destStartSample);
+
+        const auto range = juce::FloatVectorOperations::findMinAndMax(source, numSamplesToCopy);
+        const float peak = juce::jmax(-range.getStart(), range.getEnd());
+        const float gain = peak > 0.f ? peak / MAX_VALUE : 1.f;
+        gains[size_t(destChannel)] = gain;
+
+        const float scale = 1.f / gain;
+        auto* dest = data.data() + size_t(destChannel) * size_t(numSamples);
+        for (int i = 0; i < numSamplesToCopy; i++)
+            dest[i] = int16_t(std::lround(source[i] * scale));
+    }
+
+private:
+    static constexpr float MAX_VALUE{ 32767.f };
+
+    int numChannels{ 0 }, numSamples{ 0 };
+    std::vector<int16_t> data;
+    std::vector<float> gains;
+};
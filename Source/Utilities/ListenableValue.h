@@ -81,7 +81,7 @@ public:
         return store(newValue);
     }
 
-    operator T()
+    operator T() const
     {
         return load();
     }
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    MappedBuffer.cpp
+    Created: 17 Oct 2026 1:12:40am
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#include "MappedBuffer.h"
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#else
+ #include <sys/mman.h>
+#endif
+
+static bool lockPages(void* address, size_t bytes)
+{
+   #if JUCE_WINDOWS
+    if (VirtualLock(address, bytes) != 0)
+        return true;
+
+    // Locked pages count towards the process's minimum working set, which is small by default. It's grown as needed and kept,
+    // so it stays as large as the most that was locked at once.
+    SIZE_T minimum, maximum;
+    const HANDLE process = GetCurrentProcess();
+    if (GetLastError() != ERROR_WORKING_SET_QUOTA || !GetProcessWorkingSetSize(process, &minimum, &maximum) ||
+        !SetProcessWorkingSetSize(process, minimum + bytes, juce::jmax<SIZE_T>(maximum, minimum + bytes)))
+        return false;
+
+    return VirtualLock(address, bytes) != 0;
+   #else
+    return mlock(address, bytes) == 0;
+   #endif
+}
+
+static void unlockPages(void* address, size_t bytes)
+{
+   #if JUCE_WINDOWS
+    VirtualUnlock(address, bytes);
+   #else
+    munlock(address, bytes);
+   #endif
+}
+
+juce::Range<size_t> MappedBuffer::getPages(int channel, int start, int end) const
+{
+    start = juce::jlimit(0, numSamples, start);
+    end = juce::jlimit(start, numSamples, end);
+
+    const size_t first = (size_t(channel) * size_t(numSamples) + size_t(start)) * sizeof(float);
+    const size_t last = (size_t(channel) * size_t(numSamples) + size_t(end)) * sizeof(float);
+    return { first / pageSize, start == end ? first / pageSize : (last + pageSize - 1) / pageSize };
+}
+
+bool MappedBuffer::lock(int start, int end)
+{
+    if (!isValid())
+        return false;
+
+    const juce::ScopedLock scopedLock{ lockCountsLock };
+    auto* data = static_cast<char*>(mapping->getData());
+
+    // Only pages that aren't locked yet need the OS, and if it refuses, the ones locked here are released again
+    std::vector<juce::Range<size_t>> locked;
+    bool succeeded = true;
+    for (int ch = 0; ch < numChannels && succeeded; ch++)
+    {
+        forEachUnlockedRun(getPages(ch, start, end), [&](size_t firstPage, size_t numPages) {
+            if (succeeded && lockPages(data + firstPage * pageSize, numPages * pageSize))
+                locked.emplace_back(firstPage, firstPage + numPages);
+            else
+                succeeded = false;
+        });
+    }
+
+    if (!succeeded)
+    {
+        for (const auto& run : locked)
+            unlockPages(data + run.getStart() * pageSize, run.getLength() * pageSize);
+        return false;
+    }
+
+    for (int ch = 0; ch < numChannels; ch++)
+    {
+        const auto pages = getPages(ch, start, end);
+        for (size_t page = pages.getStart(); page < pages.getEnd(); page++)
+            lockCounts[page]++;
+    }
+    return true;
+}
+
+void MappedBuffer::unlock(int start, int end)
+{
+    if (!isValid())
+        return;
+
+    const juce::ScopedLock scopedLock{ lockCountsLock };
+    auto* data = static_cast<char*>(mapping->getData());
+
+    for (int ch = 0; ch < numChannels; ch++)
+    {
+        const auto pages = getPages(ch, start, end);
+        for (size_t page = pages.getStart(); page < pages.getEnd(); page++)
+        {
+            jassert(lockCounts[page] > 0);
+            lockCounts[page]--;
+        }
+
+        forEachUnlockedRun(pages, [&](size_t firstPage, size_t numPages) {
+            unlockPages(data + firstPage * pageSize, numPages * pageSize);
+        });
+    }
+}
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    MappedBuffer.h
+    Created: 16 Oct 2026 9:47:12pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Sample data that lives in a memory mapped scratch file instead of in memory, for samples too large to hold in RAM. The OS
+    pages the file in as it's read and drops pages that haven't been used in a while. The channels are stored one after another,
+    so the mapped data can be referred to by a juce::AudioBuffer<float> and used anywhere the sample is.
+
+    Running out of disk space while writing to the mapping can't be recovered from, so the file is only created if there's room
+    for it. The scratch file is deleted along with the MappedBuffer, so it must outlive any buffer referring to it.
+
+    Parts of the data can be locked in memory, so that reading them never waits on the disk (see SampleReadAhead). Locks are
+    counted for each page, since several instances can be playing the same sample, and each lock() must be matched by an unlock()
+    of the same range.
+*/
+class MappedBuffer final
+{
+public:
+    static constexpr juce::int64 MIN_FREE_BYTES{ juce::int64(1024) * 1024 * 1024 };  // Left free on the disk, for everything else
+
+    /** Creates and maps the scratch file, which reads as silence until it's written to. Check isValid() before using it. */
+    MappedBuffer(int numChannels, int numSamples) : numChannels(numChannels), numSamples(numSamples),
+        file(juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("JustaSample_Stream", ".tmp", false))
+    {
+        const auto bytes = juce::int64(numChannels) * numSamples * juce::int64(sizeof(float));
+        if (bytes <= 0 || file.getParentDirectory().getBytesFreeOnVolume() < bytes + MIN_FREE_BYTES)
+            return;
+
+        // Writing the last byte sizes the file
+        {
+            juce::FileOutputStream stream{ file };
+            if (stream.failedToOpen() || !stream.setPosition(bytes - 1) || !stream.writeByte(0))
+                return;
+
+            stream.flush();
+            if (stream.getStatus().failed())
+                return;
+        }
+
+        mapping = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readWrite);
+        if (mapping->getData() == nullptr || mapping->getSize() < size_t(bytes))
+        {
+            mapping = nullptr;
+            return;
+        }
+
+        auto* data = static_cast<float*>(mapping->getData());
+        channels.resize(size_t(numChannels));
+        for (int ch = 0; ch < numChannels; ch++)
+            channels[size_t(ch)] = data + size_t(ch) * size_t(numSamples);
+
+        pageSize = size_t(juce::SystemStats::getPageSize());
+        lockCounts.resize((size_t(bytes) + pageSize - 1) / pageSize, 0);
+
+       #if ! JUCE_WINDOWS
+        // The mapping keeps the data alive, and this way the file doesn't outlive a crash
+        file.deleteFile();
+       #endif
+    }
+
+    ~MappedBuffer()
+    {
+        mapping = nullptr;
+        file.deleteFile();
+    }
+
+    bool isValid() const { return mapping != nullptr; }
+
+    float* const* getChannels() const { return channels.data(); }
+    int getNumChannels() const { return numChannels; }
+    int getNumSamples() const { return numSamples; }
+
+    /** Locks samples [start, end) of every channel in memory, loading them first if they were paged out. Returns false, with nothing
+        locked, if the OS refuses (it limits how much memory a process can lock).
+    */
+    bool lock(int start, int end);
+
+    /** Releases a lock(start, end) that succeeded */
+    void unlock(int start, int end);
+
+private:
+    /** The pages of the mapping holding samples [start, end) of a channel */
+    juce::Range<size_t> getPages(int channel, int start, int end) const;
+
+    /** Calls function(firstPage, numPages) for each run of pages in the range whose lock count is zero */
+    template <typename Function>
+    void forEachUnlockedRun(juce::Range<size_t> pages, Function&& function) const
+    {
+        size_t runStart = pages.getStart();
+        for (size_t page = pages.getStart(); page <= pages.getEnd(); page++)
+        {
+            if (page == pages.getEnd() || lockCounts[page] > 0)
+            {
+                if (page > runStart)
+                    function(runStart, page - runStart);
+                runStart = page + 1;
+            }
+        }
+    }
+
+    int numChannels, numSamples;
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+    std::vector<float*> channels;
+
+    size_t pageSize{ 4096 };
+    std::vector<uint16_t> lockCounts;  // For each page of the mapping
+    juce::CriticalSection lockCountsLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MappedBuffer)
+};
@@ -0,0 +1,244 @@
+/*
+  ==============================================================================
+
+    SampleHash.h
+    Created: 16 Oct 2026 11:21:05pm
+    Author:  binya
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+#ifndef JAS_FAST_SAMPLE_HASH
+#define JAS_FAST_SAMPLE_HASH false
+#endif
+
+/** How a sample hash was computed. MD5 hashes are plain hex strings, as they were in projects saved before there was a choice.
+    Any other format is prefixed with its name, so a saved hash can always be checked against a sample hashed the same way.
+*/
+enum class SampleHashFormat
+{
+    md5,
+    xxh64
+};
+
+static const juce::String XXH64_HASH_PREFIX{ "xxh64:" };
+
+/** The format that new samples are hashed with */
+inline SampleHashFormat getDefaultHashFormat()
+{
+    return JAS_FAST_SAMPLE_HASH ? SampleHashFormat::xxh64 : SampleHashFormat::md5;
+}
+
+/** The format the hash was computed with, so that it can be compared with a sample hashed the same way */
+inline SampleHashFormat getHashFormat(const juce::String& hash)
+{
+    return hash.startsWith(XXH64_HASH_PREFIX) ? SampleHashFormat::xxh64 : SampleHashFormat::md5;
+}
+
+//==============================================================================
+/** An incremental implementation of XXH64, a fast non-cryptographic hash. Input is read as little endian, like every platform
+    the plugin is built for.
+*/
+class XXHash64 final
+{
+public:
+    explicit XXHash64(uint64_t seed = 0) :
+        accumulators{ seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 }, seed(seed)
+    {
+    }
+
+    void update(const void* data, size_t size)
+    {
+        auto* input = static_cast<const uint8_t*>(data);
+        totalLength += size;
+
+        // Fill up the stripe left over from the last update first
+        if (bufferSize + size < STRIPE_SIZE)
+        {
+            std::memcpy(buffer + bufferSize, input, size);
+            bufferSize += size;
+            return;
+        }
+        if (bufferSize > 0)
+        {
+            const size_t fill = STRIPE_SIZE - bufferSize;
+            std::memcpy(buffer + bufferSize, input, fill);
+            processStripe(buffer);
+            input += fill;
+            size -= fill;
+            bufferSize = 0;
+        }
+
+        for (; size >= STRIPE_SIZE; input += STRIPE_SIZE, size -= STRIPE_SIZE)
+            processStripe(input);
+
+        std::memcpy(buffer, input, size);
+        bufferSize = size;
+    }
+
+    uint64_t getDigest() const
+    {
+        uint64_t hash;
+        if (totalLength >= STRIPE_SIZE)
+        {
+            hash = rotate(accumulators[0], 1) + rotate(accumulators[1], 7) + rotate(accumulators[2], 12) + rotate(accumulators[3], 18);
+            for (auto accumulator : accumulators)
+                hash = (hash ^ round(0, accumulator)) * PRIME_1 + PRIME_4;
+        }
+        else
+        {
+            hash = seed + PRIME_5;
+        }
+        hash += totalLength;
+
+        // The remaining bytes, which didn't make up a full stripe
+        const uint8_t* input = buffer;
+        size_t remaining = bufferSize;
+        for (; remaining >= 8; input += 8, remaining -= 8)
+            hash = rotate(hash ^ round(0, read<uint64_t>(input)), 27) * PRIME_1 + PRIME_4;
+        if (remaining >= 4)
+        {
+            hash = rotate(hash ^ (uint64_t(read<uint32_t>(input)) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+            input += 4;
+            remaining -= 4;
+        }
+        for (; remaining > 0; input++, remaining--)
+            hash = rotate(hash ^ (*input * PRIME_5), 11) * PRIME_1;
+
+        hash ^= hash >> 33;
+        hash *= PRIME_2;
+        hash ^= hash >> 29;
+        hash *= PRIME_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t PRIME_1{ 0x9E3779B185EBCA87ull };
+    static constexpr uint64_t PRIME_2{ 0xC2B2AE3D27D4EB4Full };
+    static constexpr uint64_t PRIME_3{ 0x165667B19E3779F9ull };
+    static constexpr uint64_t PRIME_4{ 0x85EBCA77C2B2AE63ull };
+    static constexpr uint64_t PRIME_5{ 0x27D4EB2F165667C5ull };
+    static constexpr size_t STRIPE_SIZE{ 32 };
+
+    static uint64_t rotate(uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+    static uint64_t round(uint64_t accumulator, uint64_t input) { return rotate(accumulator + input * PRIME_2, 31) * PRIME_1; }
+
+    template <typename T>
+    static T read(const uint8_t* input)
+    {
+        T value;
+        std::memcpy(&value, input, sizeof(T));
+        return value;
+    }
+
+    void processStripe(const uint8_t* stripe)
+    {
+        for (size_t i = 0; i < 4; i++)
+            accumulators[i] = round(accumulators[i], read<uint64_t>(stripe + i * 8));
+    }
+
+    uint64_t accumulators[4];
+    uint64_t seed;
+    uint8_t buffer[STRIPE_SIZE]{};
+    size_t bufferSize{ 0 };
+    uint64_t totalLength{ 0 };
+};
+
+//==============================================================================
+/** Reads the channels of a buffer one after another, without copying them into a single block first */
+class BufferInputStream final : public juce::InputStream
+{
+public:
+    explicit BufferInputStream(const juce::AudioBuffer<float>& buffer) : buffer(buffer),
+        channelSize(juce::int64(buffer.getNumSamples()) * juce::int64(sizeof(float)))
+    {
+    }
+
+    juce::int64 getTotalLength() override { return channelSize * buffer.getNumChannels(); }
+    bool isExhausted() override { return position >= getTotalLength(); }
+    juce::int64 getPosition() override { return position; }
+
+    bool setPosition(juce::int64 newPosition) override
+    {
+        position = juce::jlimit(juce::int64(0), getTotalLength(), newPosition);
+        return true;
+    }
+
+    int read(void* destBuffer, int maxBytesToRead) override
+    {
+        auto* dest = static_cast<char*>(destBuffer);
+        int bytesRead = 0;
+        while (bytesRead < maxBytesToRead && !isExhausted())
+        {
+            const int channel = int(position / channelSize);
+            const juce::int64 offset = position % channelSize;
+            const int numBytes = int(juce::jmin(channelSize - offset, juce::int64(maxBytesToRead - bytesRead)));
+
+            std::memcpy(dest + bytesRead, reinterpret_cast<const char*>(buffer.getReadPointer(channel)) + offset, size_t(numBytes));
+            bytesRead += numBytes;
+            position += numBytes;
+        }
+        return bytesRead;
+    }
+
+private:
+    const juce::AudioBuffer<float>& buffer;
+    const juce::int64 channelSize;
+    juce::int64 position{ 0 };
+};
+
+//==============================================================================
+/** Hashes a sample a part at a time, so that it can be done while the sample is loading. The fast format hashes each channel
+    separately and combines the results, so it's computed as the parts come in. MD5 hashes the channels one after another (for
+    compatibility with existing hashes), so it can only start once the sample is complete, in getHash().
+*/
+class SampleHasher final
+{
+public:
+    SampleHasher(SampleHashFormat format, int numChannels) : format(format)
+    {
+        if (format == SampleHashFormat::xxh64)
+            channelHashes.resize(size_t(numChannels));
+    }
+
+    /** Adds the next part of the sample, which must come right after the last one */
+    void update(const juce::AudioBuffer<float>& sample, int startSample, int numSamples)
+    {
+        for (size_t ch = 0; ch < channelHashes.size(); ch++)
+            channelHashes[ch].update(sample.getReadPointer(int(ch), startSample), size_t(numSamples) * sizeof(float));
+    }
+
+    /** The hash of the sample, all of which must have been passed to update() */
+    juce::String getHash(const juce::AudioBuffer<float>& sample) const
+    {
+        if (format == SampleHashFormat::md5)
+        {
+            BufferInputStream stream{ sample };
+            return juce::MD5{ stream }.toHexString();
+        }
+
+        XXHash64 combined;
+        for (const auto& channelHash : channelHashes)
+        {
+            const uint64_t digest = channelHash.getDigest();
+            combined.update(&digest, sizeof(digest));
+        }
+        return XXH64_HASH_PREFIX + juce::String::toHexString(juce::int64(combined.getDigest())).paddedLeft('0', 16);
+    }
+
+private:
+    SampleHashFormat format;
+    std::vector<XXHash64> channelHashes;
+};
+
+/** Generates an identifier for the AudioBuffer, without copying it */
+inline juce::String getSampleHash(const juce::AudioBuffer<float>& buffer, SampleHashFormat format = getDefaultHashFormat())
+{
+    SampleHasher hasher{ format, buffer.getNumChannels() };
+    hasher.update(buffer, 0, buffer.getNumSamples());
+    return hasher.getHash(buffer);
+}
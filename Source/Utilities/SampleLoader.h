@@ -12,14 +12,23 @@
 
 #include <JuceHeader.h>
 
-#include "BufferUtils.h"
+#include "MappedBuffer.h"
+#include "SampleHash.h"
+#include "../PluginParameters.h"
 
-/** A utility thread for asynchronously loading samples */
+/** A utility thread for asynchronously loading samples, a chunk at a time so that it can be canceled partway through. Samples
+    larger than MIN_STREAMED_BYTES are loaded into a MappedBuffer instead of into memory, and the loaded buffer refers to it.
+
+    With onHeadLoaded, the sample can be released as soon as its first chunk is loaded, while the rest keeps loading into it in
+    place. Whoever takes it must keep it alive until the thread has finished or been stopped.
+*/
 class LoaderThread final : public juce::Thread
 {
 public:
-    LoaderThread(std::unique_ptr<juce::AudioFormatReader> formatReader, int threadID) : Thread("Loader_Thread_" + juce::String(threadID)),
-        reader{std::move(formatReader)}
+    static constexpr int CHUNK_SIZE{ 65536 };  // In samples
+
+    LoaderThread(std::unique_ptr<juce::AudioFormatReader> formatReader, SampleHashFormat hashFormat, int threadID) : Thread("Loader_Thread_" + juce::String(threadID)),
+        reader{std::move(formatReader)}, hashFormat{ hashFormat }, loadID{ threadID }, sampleRate{ reader->sampleRate }
     {
     }
 
@@ -33,66 +42,185 @@ public:
         canceled = true;
     }
 
+    /** Called on the loader thread once the first chunk is loaded, if the sample takes more than one. Set before starting the thread. */
+    std::function<void()> onHeadLoaded;
+
     juce::AudioBuffer<float>* releaseSample() { return newSample.release(); }
+    MappedBuffer* releaseMappedSample() { return mappedSample.release(); }
     juce::AudioFormatReader* releaseReader() { return reader.release(); }
     const juce::String& getLoadedSampleHash() const { return sampleHash; }
 
+    int getLoadID() const { return loadID; }
+    double getSampleRate() const { return sampleRate; }
+    /** How many samples have been loaded so far */
+    int getLoadedLength() const { return loadedLength.load(std::memory_order_acquire); }
+    bool isFinished() const { return finished.load(); }
+
 private:
     void run() override
     {
-        newSample = std::make_unique<juce::AudioBuffer<float>>(int(reader->numChannels), int(reader->lengthInSamples));
-        reader->read(&*newSample, 0, int(reader->lengthInSamples), 0, true, true);
-        sampleHash = getSampleHash(*newSample);
+        const int numChannels = int(reader->numChannels);
+        const int length = int(reader->lengthInSamples);
+
+        // Samples too large to hold in memory are loaded into a scratch file instead, if there's room for it
+        if (size_t(numChannels) * size_t(length) * sizeof(float) > PluginParameters::MIN_STREAMED_BYTES)
+        {
+            auto mapped = std::make_unique<MappedBuffer>(numChannels, length);
+            if (mapped->isValid())
+            {
+                newSample = std::make_unique<juce::AudioBuffer<float>>(mapped->getChannels(), numChannels, length);
+                mappedSample = std::move(mapped);
+            }
+        }
+
+        // What isn't loaded yet reads as silence
+        if (!newSample)
+        {
+            newSample = std::make_unique<juce::AudioBuffer<float>>();
+            newSample->setSize(numChannels, length, false, true);
+        }
+
+        // The sample can be released partway through, so it's loaded through a buffer that refers to the same data
+        juce::AudioBuffer<float> destination{ newSample->getArrayOfWritePointers(), numChannels, length };
+        SampleHasher hasher{ hashFormat, numChannels };
+        for (int start = 0; start < length && !canceled; start += CHUNK_SIZE)
+        {
+            const int chunkLength = juce::jmin(CHUNK_SIZE, length - start);
+            reader->read(&destination, start, chunkLength, start, true, true);
+            hasher.update(destination, start, chunkLength);
+            loadedLength.store(start + chunkLength, std::memory_order_release);
+
+            if (start == 0 && chunkLength < length && onHeadLoaded)
+                onHeadLoaded();
+        }
 
         if (canceled)
+        {
             newSample = nullptr;
+            mappedSample = nullptr;
+        }
+        else
+        {
+            sampleHash = hasher.getHash(destination);
+        }
 
+        finished = true;
         signalThreadShouldExit();
     }
 
     std::unique_ptr<juce::AudioFormatReader> reader;
+    const SampleHashFormat hashFormat;
+    const int loadID;
+    const double sampleRate;
+
+    std::unique_ptr<MappedBuffer> mappedSample;  // Declared before newSample, which can refer to it
     std::unique_ptr<juce::AudioBuffer<float>> newSample;
     juce::String sampleHash;
-    bool canceled{ false };
+
+    std::atomic<int> loadedLength{ 0 };
+    std::atomic<bool> canceled{ false };
+    std::atomic<bool> finished{ false };
 };
 
-/** Asynchronously loads a sample */
+/** Asynchronously loads a sample. With onHeadLoaded, a sample that takes more than one chunk is handed over as soon as its head is
+    loaded, so that it can be shown and played right away, and the rest loads into it in place. The completion callback then gets no
+    sample, only the hash of the whole thing.
+
+    Starting another load or canceling waits for the current chunk to finish, so a sample that was handed over can be deleted after.
+*/
 class SampleLoader final : public juce::Thread::Listener
 {
 public:
-    void loadSample(std::unique_ptr<juce::AudioFormatReader> formatReader, 
-        const std::function<void(const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String& sampleHash, const std::unique_ptr<juce::AudioFormatReader>& reader)>& onCompletion)
+    ~SampleLoader() override
+    {
+        cancel();
+    }
+
+    /** The sample is hashed with hashFormat, which should match the format of any hash it's going to be compared with */
+    void loadSample(std::unique_ptr<juce::AudioFormatReader> formatReader, SampleHashFormat hashFormat,
+        const std::function<void(const std::unique_ptr<juce::AudioBuffer<float>>& loadedSample, const juce::String& sampleHash, const std::unique_ptr<juce::AudioFormatReader>& reader,
+            std::unique_ptr<MappedBuffer> mappedSample)>& onCompletion,
+        const std::function<void(const std::unique_ptr<juce::AudioBuffer<float>>& loadingSample, double sampleRate, std::unique_ptr<MappedBuffer> mappedSample)>& onHeadLoaded = nullptr)
     {
+        cancel();
         loading = true;
         completionCallback = onCompletion;
-        for (const auto& thread : threads)
+        headCallback = onHeadLoaded;
+
+        thread = std::make_unique<LoaderThread>(std::move(formatReader), hashFormat, ++ids);
+        thread->addListener(this);
+        if (headCallback)
+            thread->onHeadLoaded = [this, id = ids] { juce::MessageManager::callAsync([this, id] { headLoaded(id); }); };
+        thread->startThread();
+    }
+
+    /** Finishes a load with a sample that's already in memory, such as one from the SampleCache. Like any other load, this
+        replaces the current one, can be canceled, and completes on the message thread.
+    */
+    void loadCached(const std::function<void()>& onCompletion)
+    {
+        cancel();
+        loading = true;
+        juce::MessageManager::callAsync([this, id = ++ids, onCompletion] {
+            if (id != ids || !loading)
+                return;
+
+            loading = false;
+            onCompletion();
+        });
+    }
+
+    /** Stops loading, waiting for the current chunk to finish. A sample that was handed over stays partly loaded. */
+    void cancel()
+    {
+        if (thread)
         {
             thread->cancel();
             thread->removeListener(this);
+            thread = nullptr;
         }
-        
-        auto newThread = std::make_unique<LoaderThread>(std::move(formatReader), ++ids);
-        newThread->addListener(this);
-        newThread->startThread();
-        threads.emplace_back(std::move(newThread));
+        handedOver = false;
+        loading = false;
     }
 
     bool isLoading() const { return loading; }
 
+    /** While a sample that was handed over is still loading, how many of its samples are loaded, otherwise -1 */
+    int getProgress() const { return handedOver && thread ? thread->getLoadedLength() : -1; }
+
 private:
+    void headLoaded(int id)
+    {
+        if (!thread || thread->getLoadID() != id || !headCallback)
+            return;
+
+        handedOver = true;
+        headCallback(std::unique_ptr<juce::AudioBuffer<float>>(thread->releaseSample()), thread->getSampleRate(), std::unique_ptr<MappedBuffer>(thread->releaseMappedSample()));
+    }
+
     void exitSignalSent() override
     {
         juce::MessageManager::callAsync([this]() -> void {
-            auto& lastThread = threads[threads.size() - 1];
-            completionCallback(std::unique_ptr<juce::AudioBuffer<float>>(lastThread->releaseSample()), lastThread->getLoadedSampleHash(), std::unique_ptr<juce::AudioFormatReader>(lastThread->releaseReader()));
+            // Only the current thread delivers its sample, and only once
+            if (!thread || !thread->isFinished())
+                return;
+
+            // The callback can start another load, which replaces it
+            auto finishedThread = std::move(thread);
+            auto onCompletion = completionCallback;
+            handedOver = false;
             loading = false;
+            onCompletion(std::unique_ptr<juce::AudioBuffer<float>>(finishedThread->releaseSample()), finishedThread->getLoadedSampleHash(), std::unique_ptr<juce::AudioFormatReader>(finishedThread->releaseReader()),
+                std::unique_ptr<MappedBuffer>(finishedThread->releaseMappedSample()));
         });
     }
 
     //==============================================================================
     int ids{ 0 };
-    std::vector<std::unique_ptr<LoaderThread>> threads;
+    std::unique_ptr<LoaderThread> thread;
+    bool handedOver{ false };
 
-    std::function<void(std::unique_ptr<juce::AudioBuffer<float>>, const juce::String&, std::unique_ptr<juce::AudioFormatReader>)> completionCallback;
+    std::function<void(std::unique_ptr<juce::AudioBuffer<float>>, const juce::String&, std::unique_ptr<juce::AudioFormatReader>, std::unique_ptr<MappedBuffer>)> completionCallback;
+    std::function<void(std::unique_ptr<juce::AudioBuffer<float>>, double, std::unique_ptr<MappedBuffer>)> headCallback;
     bool loading{ false };
 };